@@ -0,0 +1,92 @@
+/*
+	Admission of runs against a memory budget for the
+	host. Every run reserves its memory limit before it
+	starts, and gives it back when it is over; a run
+	that does not fit waits. As no run can go past its
+	limit, runs at once never need more than the budget,
+	and the host never swaps under a burst of them.
+
+	Runs are admitted in the order they ask, so a large
+	one is not passed over by smaller ones for good; a
+	run larger than the budget is let in alone.
+*/
+
+#include <pthread.h>
+
+#include "common.h"
+#include "admit.h"
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t freed = PTHREAD_COND_INITIALIZER;
+static size_t budget, reserved, highest;
+static unsigned long ticket, serving;
+static int queued;
+
+/* how it copes, times in ms */
+static long admitted, delayed;
+static double waited, longest;
+
+static void fallback(void) {
+	if (!budget)
+		budget = (size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / ADMIT_SHARE;
+}
+
+void admit_budget(size_t bytes) {
+	pthread_mutex_lock(&lock);
+	budget = bytes;
+	pthread_cond_broadcast(&freed);
+	pthread_mutex_unlock(&lock);
+}
+
+/*
+	reserve bytes for a run, waiting until they fit;
+	returns how long it waited, in ms
+*/
+long admit_enter(size_t bytes) {
+	struct timespec start, now;
+	unsigned long mine;
+	double ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_mutex_lock(&lock);
+	fallback();
+	mine = ticket++;
+	queued++;
+	while (mine != serving || (reserved && reserved + bytes > budget))
+		pthread_cond_wait(&freed, &lock);
+	serving++;
+	queued--;
+	reserved += bytes;
+	if (reserved > highest)
+		highest = reserved;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (now.tv_sec - start.tv_sec) * 1e3 + (now.tv_nsec - start.tv_nsec) / 1e6;
+	admitted++;
+	waited += ms;
+	if (ms >= 1)
+		delayed++;
+	if (ms > longest)
+		longest = ms;
+	/* the next in turn may fit as well */
+	pthread_cond_broadcast(&freed);
+	pthread_mutex_unlock(&lock);
+	return ms;
+}
+
+void admit_leave(size_t bytes) {
+	pthread_mutex_lock(&lock);
+	reserved -= bytes;
+	pthread_cond_broadcast(&freed);
+	pthread_mutex_unlock(&lock);
+}
+
+void admit_report(FILE *fp) {
+	pthread_mutex_lock(&lock);
+	fallback();
+	fprintf(fp, "memory: %zuMB of %zuMB reserved (%zuMB at most), %d waiting,"
+		" %ld admitted, %ld delayed, waited %.1fms on average, %.1fms at most\n",
+		reserved >> 20, budget >> 20, highest >> 20, queued, admitted, delayed,
+		admitted ? waited / admitted : 0, longest);
+	pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,15 @@
+#ifndef ADMIT_H
+#define ADMIT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* share of the host memory that runs may reserve by default */
+#define ADMIT_SHARE 2	/* a half */
+
+void admit_budget(size_t bytes);
+long admit_enter(size_t bytes);
+void admit_leave(size_t bytes);
+void admit_report(FILE *fp);
+
+#endif
@@ -0,0 +1,371 @@
+/*
+	The socket side of judged, for a frontend that must
+	not wait on a judgement. It speaks lines of text:
+
+	submit source_file problem_folder [user [section]]
+		answered by "id N" once the job is in the
+		journal, "error journal" if it could not be
+		written there, though the job is judged, or
+		"error busy"
+	watch N
+		streams the events of job N, past and to come:
+		"N queued", "N compiled", "N compile error",
+		"N test I VERDICT TIMEms MEMKB" for each test
+		that counts, "N preliminary VERDICT" once the
+		samples of the problem are judged, if it has any,
+		"N cached M" if the verdict is that of job M, the
+		same submission, and last "N verdict ..." as
+		the line judge.sh prints; "N unknown" if it is
+		forgotten
+	stats
+		"stats ..." lines on throughput, latency, the
+		depth and waits of each stage, the verdicts
+		reused, and how long the jobs of each user and
+		section were queued
+
+	Every client is served from the thread that polls,
+	with a bounded buffer each; a watch that does not
+	fit waits until the client reads more. Replies are
+	never lost: they may run past the bound, but then
+	the client's requests wait until it reads more.
+*/
+
+#include "common.h"
+#include "judged.h"
+#include "journal.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdarg.h>
+
+/* the longest request */
+#define API_LINE 1024
+
+/* what is written ahead for a client, replies aside */
+#define API_BUFFER (1 << 14)
+
+struct watch {
+	long id;
+	size_t off;
+};
+
+struct client {
+	int fd;
+	char in[API_LINE];
+	size_t in_len;
+	char *out;
+	size_t out_len, out_size;
+
+	struct watch *watch;
+	int watches;
+
+	/* the jobs submitted, told once they are synced; -1
+	   for one that was not queued, and meanwhile no
+	   other request is served, to keep the replies in
+	   order */
+	long *ids;
+	int nids;
+
+	/* what poll said of it, -1 once it is to be dropped */
+	int ready;
+
+	/* a reply did not fit in memory */
+	int lost;
+};
+
+static int listener = -1, submitted;
+static struct client **clients;
+static int nclients;
+static struct pollfd *pfds;
+
+int api_listen(const char *path) {
+	struct sockaddr_un addr;
+
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof addr.sun_path)
+		return -1;
+	strcpy(addr.sun_path, path);
+
+	/* a socket left by a previous run is in the way */
+	unlink(path);
+	if (-1 == (listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)))
+		return -1;
+	if (-1 == bind(listener, (struct sockaddr *)&addr, sizeof addr)
+		|| -1 == listen(listener, SOMAXCONN)) {
+		close(listener);
+		return listener = -1;
+	}
+	return 0;
+}
+
+static void drop(int i) {
+	close(clients[i]->fd);
+	free(clients[i]->out);
+	free(clients[i]->watch);
+	free(clients[i]->ids);
+	free(clients[i]);
+	clients[i] = clients[--nclients];
+}
+
+/*
+	the buffer grows to take a reply, the client is
+	dropped rather than lose it
+*/
+static void reply(struct client *c, const char *fmt, ...) {
+	va_list ap;
+	char *more;
+	size_t size;
+	int n;
+
+	for ( ; ; ) {
+		va_start(ap, fmt);
+		n = vsnprintf(c->out + c->out_len, c->out_size - c->out_len, fmt, ap);
+		va_end(ap);
+		if (n < 0) {
+			c->lost = 1;
+			return;
+		}
+		if (c->out_len + n < c->out_size)
+			break;
+		for (size = c->out_size; size <= c->out_len + n; size *= 2)
+			;
+		if (NULL == (more = realloc(c->out, size))) {
+			c->lost = 1;
+			return;
+		}
+		c->out = more;
+		c->out_size = size;
+	}
+	c->out_len += n;
+}
+
+static void request(struct client *c, char *line) {
+	char source[PATH_MAX], folder[PATH_MAX], user[64], section[64], *text;
+	struct watch *w;
+	size_t len;
+	FILE *fp;
+	long id, *ids;
+	int n;
+
+	if ((n = sscanf(line, "submit %4095s %4095s %63s %63s", source, folder, user, section)) >= 2) {
+		if (NULL == (ids = realloc(c->ids, (c->nids + 1) * sizeof *ids))) {
+			c->lost = 1;
+			return;
+		}
+		c->ids = ids;
+		c->ids[c->nids++] = id = job_new(NULL, source, folder,
+			n >= 3 ? user : NULL, n >= 4 ? section : NULL);
+		submitted |= -1 != id;
+	} else if (1 == sscanf(line, "watch %ld", &id)) {
+		if (NULL == (w = realloc(c->watch, (c->watches + 1) * sizeof *w))) {
+			reply(c, "error busy\n");
+			return;
+		}
+		c->watch = w;
+		c->watch[c->watches].id = id;
+		c->watch[c->watches].off = 0;
+		c->watches++;
+	} else if (0 == strcmp(line, "stats")) {
+		if (NULL == (fp = open_memstream(&text, &len))) {
+			reply(c, "error busy\n");
+			return;
+		}
+		job_stats(fp);
+		fclose(fp);
+		for (line = strtok(text, "\n"); line; line = strtok(NULL, "\n"))
+			reply(c, "stats %s\n", line);
+		free(text);
+	} else
+		reply(c, "error bad request\n");
+}
+
+/*
+	move what the watched jobs said since into the
+	buffer, as far as it goes
+*/
+static void pull(struct client *c) {
+	int i, over;
+	size_t n;
+
+	for (i = 0; i < c->watches && c->out_len < API_BUFFER; ) {
+		n = job_events(c->watch[i].id, c->watch[i].off, c->out + c->out_len,
+			API_BUFFER - c->out_len, &over);
+		if (!n && over && !c->watch[i].off)
+			reply(c, "%ld unknown\n", c->watch[i].id);
+		c->out_len += n;
+		c->watch[i].off += n;
+		if (over)
+			c->watch[i] = c->watch[--c->watches];
+		else
+			++i;
+	}
+}
+
+/*
+	returns -1 when the client is to be dropped
+*/
+static int push(struct client *c) {
+	ssize_t n;
+
+	pull(c);
+	while (c->out_len) {
+		if ((n = write(c->fd, c->out, c->out_len)) < 0)
+			return EAGAIN == errno ? 0 : -1;
+		memmove(c->out, c->out + n, c->out_len - n);
+		c->out_len -= n;
+		pull(c);
+	}
+	return 0;
+}
+
+/*
+	serve the requests read, and read more, as long as
+	the replies so far are within the bound
+*/
+static int receive(struct client *c) {
+	ssize_t n;
+	char *nl;
+
+	for ( ; ; ) {
+		while (c->out_len < API_BUFFER && (nl = memchr(c->in, '\n', c->in_len))
+			&& (!c->nids || 0 == strncmp(c->in, "submit ", 7))) {
+			*nl = '\0';
+			request(c, c->in);
+			c->in_len -= nl + 1 - c->in;
+			memmove(c->in, nl + 1, c->in_len);
+		}
+		if (c->lost)
+			return -1;
+		if (c->out_len >= API_BUFFER || (c->nids && memchr(c->in, '\n', c->in_len)))
+			return 0;
+		/* a line that long is no request */
+		if (sizeof c->in == c->in_len)
+			return -1;
+
+		n = read(c->fd, c->in + c->in_len, sizeof c->in - c->in_len);
+		if (n < 0)
+			return EAGAIN == errno ? 0 : -1;
+		if (0 == n)
+			return -1;
+		c->in_len += n;
+	}
+}
+
+static void welcome(void) {
+	int fd;
+	struct client *c, **more;
+
+	while (-1 != (fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC))) {
+		if ((c = calloc(1, sizeof *c)) && NULL == (c->out = malloc(API_BUFFER))) {
+			free(c);
+			c = NULL;
+		}
+		more = realloc(clients, (nclients + 1) * sizeof *clients);
+		if (!c || !more) {
+			if (c)
+				free(c->out);
+			free(c);
+			close(fd);
+			continue;
+		}
+		clients = more;
+		c->fd = fd;
+		c->out_size = API_BUFFER;
+		clients[nclients++] = c;
+	}
+}
+
+/*
+	fill pfd past the reserved entries with the
+	listener and the clients; returns how many in all
+*/
+int api_prepare(struct pollfd **pfd, int reserved) {
+	int i, n = reserved;
+	struct pollfd *more;
+
+	if (NULL == (more = realloc(pfds, (reserved + 1 + nclients) * sizeof *pfds)))
+		return -1;
+	pfds = more;
+	if (-1 != listener) {
+		pfds[n].fd = listener;
+		pfds[n++].events = POLLIN;
+	}
+	for (i = 0; i < nclients; ++i) {
+		pfds[n].fd = clients[i]->fd;
+		/* no more requests until the replies are read, and
+		   those held back are served once it is writable */
+		pfds[n++].events = (clients[i]->out_len < API_BUFFER ? POLLIN : 0)
+			| (clients[i]->out_len || memchr(clients[i]->in, '\n', clients[i]->in_len) ? POLLOUT : 0);
+	}
+	*pfd = pfds;
+	return n;
+}
+
+/*
+	serve what poll found, pfd being past the reserved
+	entries; the jobs submitted meanwhile are synced to
+	the journal all at once, before any is answered
+*/
+void api_handle(struct pollfd *pfd, int n) {
+	int i, k, synced, base = -1 != listener;
+	unsigned long mark = journal_mark();
+	struct client *c;
+
+	for (i = n - 1; i >= base; --i) {
+		c = clients[i - base];
+		c->ready = pfd[i].revents;
+		/* what was written makes room for the requests held back */
+		if (pfd[i].revents & POLLOUT && -1 == push(c))
+			c->ready = -1;
+		else if ((pfd[i].revents & (POLLIN | POLLHUP | POLLERR) || c->in_len)
+			&& -1 == receive(c))
+			c->ready = -1;
+	}
+	/* the submitted are told together, synced or not */
+	synced = !submitted || 0 == journal_commit(mark);
+	submitted = 0;
+	for (i = 0; i < nclients; ++i) {
+		c = clients[i];
+		for (k = 0; k < c->nids; ++k)
+			if (-1 == c->ids[k])
+				reply(c, "error busy\n");
+			else if (synced)
+				reply(c, "id %ld\n", c->ids[k]);
+			else
+				reply(c, "error journal\n");
+		c->nids = 0;
+		if (c->lost)
+			c->ready = -1;
+	}
+
+	/* going backwards, a client dropped is only replaced
+	   by one already served */
+	for (i = nclients - 1; i >= 0; --i)
+		if (-1 == clients[i]->ready || (clients[i]->ready && -1 == push(clients[i])))
+			drop(i);
+	if (base && pfd[0].revents)
+		welcome();
+}
+
+/*
+	jobs have news, pass it on
+*/
+void api_flush(void) {
+	int i;
+
+	for (i = 0; i < nclients; )
+		if (clients[i]->watches && -1 == push(clients[i]))
+			drop(i);
+		else
+			++i;
+}
+
+void api_close(void) {
+	while (nclients)
+		drop(0);
+	free(clients);
+	free(pfds);
+	if (-1 != listener)
+		close(listener);
+}
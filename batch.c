@@ -0,0 +1,334 @@
+/*
+	batch grades the submissions of a whole class at
+	once, from a directory or an archive of one, against
+	a set of problems:
+
+		submissions/STUDENT/PROBLEM.c	(or .cpp)
+		submissions/STUDENT.c		if there is one problem
+
+	PROBLEM being the name of the problem folder. Each
+	problem is loaded once, with its checker and its
+	tokenized outputs, and a pool of workers compiles and
+	judges the submissions side by side. What comes out
+	is a students x problems matrix of verdicts, points
+	following for problems with subtasks. With -C, what
+	compiled before is kept in and taken from that
+	directory, see compile.c.
+*/
+
+#include "common.h"
+#include "problem.h"
+#include "spj.h"
+#include "judge.h"
+#include "admit.h"
+#include "compile.h"
+
+#include <pthread.h>
+#include <spawn.h>
+
+#define MSG_ERR_RET(msg, res) \
+	do { fprintf(stderr, "%s\n", msg); return(res); } while (0)
+
+#define USAGE "Usage: batch [-w workers] [-j jobs] [-M memory_mb] [-C cache_dir] submissions problem_folder..."
+
+extern char **environ;
+
+/* verdicts as short as a matrix wants them */
+static const char *code[] = {
+	[SYSTEM_ERROR] = "SE",
+	[COMPILE_ERROR] = "CE",
+	[RUNTIME_ERROR] = "RE",
+	[TIME_LIMIT_EXCEEDED] = "TLE",
+	[MEMORY_LIMIT_EXCEEDED] = "MLE",
+	[OUTPUT_LIMIT_EXCEEDED] = "OLE",
+	[PRESENTATION_ERROR] = "PE",
+	[WRONG_ANWSER] = "WA",
+	[ACCEPTED] = "AC",
+};
+
+/* a student on a problem */
+struct grade {
+	char source[PATH_MAX];	/* empty if nothing was handed in */
+	int result, points, total;
+};
+
+static struct {
+	char **student;
+	int students;
+
+	struct problem *pb;
+	struct spj *spj;
+	const char **name;
+	int problems;
+
+	/* students x problems, taken in turn by the workers */
+	struct grade *grade;
+	int next, jobs;
+	pthread_mutex_t lock;
+} batch = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static int spawn(char *const argv[]) {
+	int status;
+	pid_t pid;
+
+	if (posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ)
+		|| -1 == waitpid(pid, &status, 0))
+		return -1;
+	return WIFEXITED(status) && 0 == WEXITSTATUS(status) ? 0 : -1;
+}
+
+/*
+	an archive is unpacked into dir; returns where the
+	submissions are, inside the one folder the archive
+	may wrap them in
+*/
+static int unpack(const char *archive, char *dir, char *root, size_t size) {
+	char *tar[] = { "tar", "-xf", (char *)archive, "-C", dir, NULL };
+	struct dirent **entry;
+	struct stat st;
+	int i, n, kept = 0;
+
+	if (NULL == mkdtemp(dir))
+		MSG_ERR_RET("mkdtemp() Failed", -1);
+	if (-1 == spawn(tar))
+		MSG_ERR_RET("tar Failed", -1);
+	snprintf(root, size, "%s", dir);
+
+	if ((n = scandir(dir, &entry, NULL, NULL)) < 0)
+		return 0;
+	for (i = 0; i < n; ++i) {
+		if ('.' != *entry[i]->d_name && !kept++)
+			snprintf(root, size, "%s/%s", dir, entry[i]->d_name);
+		free(entry[i]);
+	}
+	free(entry);
+	if (1 != kept || -1 == stat(root, &st) || !S_ISDIR(st.st_mode))
+		snprintf(root, size, "%s", dir);
+	return 0;
+}
+
+static int found(char *path, size_t size, const char *dir, const char *name) {
+	const char *suffix[] = { ".c", ".cpp" };
+	int i;
+
+	for (i = 0; i < sizeof suffix / sizeof *suffix; ++i)
+		if (size > snprintf(path, size, "%s/%s%s", dir, name, suffix[i])
+			&& 0 == access(path, R_OK))
+			return 1;
+	*path = '\0';
+	return 0;
+}
+
+static int addStudent(const char *name) {
+	char **student;
+	struct grade *grade;
+
+	student = realloc(batch.student, (batch.students + 1) * sizeof *student);
+	if (student)
+		batch.student = student;
+	grade = realloc(batch.grade, (batch.students + 1) * batch.problems * sizeof *grade);
+	if (grade)
+		batch.grade = grade;
+	if (!student || !grade || NULL == (student[batch.students] = strdup(name)))
+		return -1;
+	memset(&grade[batch.students * batch.problems], 0, batch.problems * sizeof *grade);
+	return batch.students++;
+}
+
+/*
+	who handed in what, in the order of their names
+*/
+static int scan(const char *root) {
+	char path[PATH_MAX], name[NAME_MAX + 1], *dot;
+	struct dirent **entry;
+	struct grade *g;
+	struct stat st;
+	int i, n, p, k, result = 0;
+
+	if ((n = scandir(root, &entry, NULL, alphasort)) < 0)
+		MSG_ERR_RET("scandir() Failed", -1);
+	for (i = 0; i < n; ++i) {
+		snprintf(name, sizeof name, "%s", entry[i]->d_name);
+		free(entry[i]);
+		if (result || '.' == *name
+			|| sizeof path <= snprintf(path, sizeof path, "%s/%s", root, name)
+			|| -1 == stat(path, &st))
+			continue;
+
+		if (S_ISDIR(st.st_mode)) {
+			if (-1 == (k = addStudent(name))) {
+				result = -1;
+				continue;
+			}
+			for (p = 0; p < batch.problems; ++p) {
+				g = &batch.grade[k * batch.problems + p];
+				found(g->source, sizeof g->source, path, batch.name[p]);
+			}
+		} else if (1 == batch.problems && (dot = strrchr(name, '.'))
+			&& (0 == strcmp(dot, ".c") || 0 == strcmp(dot, ".cpp"))) {
+			*dot = '\0';
+			if (-1 == (k = addStudent(name))) {
+				result = -1;
+				continue;
+			}
+			snprintf(batch.grade[k].source, sizeof batch.grade[k].source, "%s", path);
+		}
+	}
+	free(entry);
+	return result;
+}
+
+static void grade(struct grade *g, const struct problem *pb) {
+	struct suite suite;
+	char bin[PATH_MAX];
+
+	g->points = -1;
+	if (-1 == suite_open(&suite, pb->dir, pb)) {
+		g->result = SYSTEM_ERROR;
+		return;
+	}
+	/* the binary lives in the workspace of the suite */
+	if (sizeof bin <= snprintf(bin, sizeof bin, "%s/main", suite.dir))
+		g->result = SYSTEM_ERROR;
+	else if (EXIT_SUCCESS == (g->result = compile(g->source, bin, "/dev/null"))) {
+		g->result = suite_run(&suite, bin, batch.jobs);
+		g->points = suite_score(&suite, &g->total);
+	}
+	suite_close(&suite);
+}
+
+static void *work(void *arg) {
+	int i;
+
+	for ( ; ; ) {
+		pthread_mutex_lock(&batch.lock);
+		i = batch.next++;
+		pthread_mutex_unlock(&batch.lock);
+		if (i >= batch.students * batch.problems)
+			return NULL;
+		if (*batch.grade[i].source)
+			grade(&batch.grade[i], &batch.pb[i % batch.problems]);
+	}
+}
+
+static void matrix(FILE *fp) {
+	const struct grade *g;
+	int k, p;
+
+	fprintf(fp, "student");
+	for (p = 0; p < batch.problems; ++p)
+		fprintf(fp, "\t%s", batch.name[p]);
+	fprintf(fp, "\n");
+
+	for (k = 0; k < batch.students; ++k) {
+		fprintf(fp, "%s", batch.student[k]);
+		for (p = 0; p < batch.problems; ++p) {
+			g = &batch.grade[k * batch.problems + p];
+			if (!*g->source)
+				fprintf(fp, "\t-");
+			else if (g->points >= 0)
+				fprintf(fp, "\t%s:%d", code[g->result], g->points);
+			else
+				fprintf(fp, "\t%s", code[g->result]);
+		}
+		fprintf(fp, "\n");
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int opt, i, n, workers = sysconf(_SC_NPROCESSORS_ONLN), graded = 0;
+	char dir[PATH_MAX] = "", root[PATH_MAX];
+	char *rm[] = { "rm", "-rf", dir, NULL };
+	struct timespec start, end;
+	struct stat st;
+	double elapsed;
+	pthread_t *worker;
+
+	batch.jobs = 1;
+	while (-1 != (opt = getopt(argc, argv, "w:j:M:C:")))
+		if (('w' == opt && (workers = atoi(optarg)) > 0)
+			|| ('j' == opt && (batch.jobs = atoi(optarg)) > 0))
+			continue;
+		else if ('M' == opt && (n = atoi(optarg)) > 0)
+			admit_budget((size_t)n << 20);
+		else if ('C' == opt && 0 == compile_cache(optarg, COMPILE_CACHE_BYTES))
+			continue;
+		else
+			EXIT_MSG(USAGE, EXIT_FAILURE);
+	if (argc - optind < 2)
+		EXIT_MSG(USAGE, EXIT_FAILURE);
+	if (workers < 1)
+		workers = 1;
+
+	/* every problem is loaded once for all */
+	batch.problems = argc - optind - 1;
+	batch.pb = calloc(batch.problems, sizeof *batch.pb);
+	batch.spj = calloc(batch.problems, sizeof *batch.spj);
+	batch.name = calloc(batch.problems, sizeof *batch.name);
+	if (!batch.pb || !batch.spj || !batch.name)
+		EXIT_MSG("calloc() Failed", EXIT_FAILURE);
+	for (i = 0; i < batch.problems; ++i) {
+		if (-1 == problem_load(&batch.pb[i], argv[optind + 1 + i]))
+			EXIT_MSG("problem_load() Failed", EXIT_FAILURE);
+		if (*batch.pb[i].checker) {
+			if (-1 == spj_open(&batch.spj[i], &batch.pb[i]))
+				EXIT_MSG("spj_open() Failed", EXIT_FAILURE);
+			batch.pb[i].spj = &batch.spj[i];
+		}
+		/* named after its folder */
+		batch.name[i] = basename(argv[optind + 1 + i]);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (-1 == stat(argv[optind], &st))
+		EXIT_MSG("stat() Failed", EXIT_FAILURE);
+	if (S_ISDIR(st.st_mode))
+		snprintf(root, sizeof root, "%s", argv[optind]);
+	else {
+		strcpy(dir, "batch.XXXXXX");
+		if (-1 == unpack(argv[optind], dir, root, sizeof root))
+			return EXIT_FAILURE;
+	}
+	if (-1 == scan(root))
+		return EXIT_FAILURE;
+
+	/* never more workers than submissions, whatever -w said */
+	if (workers > (n = batch.students * batch.problems))
+		workers = n > 0 ? n : 1;
+	if (NULL == (worker = calloc(workers, sizeof *worker)))
+		EXIT_MSG("calloc() Failed", EXIT_FAILURE);
+	for (n = 1; n < workers; ++n)
+		if (pthread_create(&worker[n], NULL, work, NULL))
+			break;
+	work(NULL);
+	while (--n > 0)
+		pthread_join(worker[n], NULL);
+	free(worker);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	matrix(stdout);
+	for (i = 0; i < batch.students * batch.problems; ++i)
+		graded += !!*batch.grade[i].source;
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "batch: %d submissions of %d students to %d problems"
+		" in %.1fs, %.2f/s, %d workers\n", graded, batch.students, batch.problems,
+		elapsed, elapsed > 0 ? graded / elapsed : 0, workers);
+	compile_report(stderr);
+
+	/* bye for now */
+	if (*dir && -1 == spawn(rm))
+		fprintf(stderr, "rm %s Failed\n", dir);
+	for (i = 0; i < batch.problems; ++i)
+		if (batch.pb[i].spj)
+			spj_close(batch.pb[i].spj);
+	for (i = 0; i < batch.students; ++i)
+		free(batch.student[i]);
+	free(batch.student);
+	free(batch.grade);
+	free(batch.pb);
+	free(batch.spj);
+	free(batch.name);
+	return EXIT_SUCCESS;
+}
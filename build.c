@@ -0,0 +1,62 @@
+/*
+	Compile a submission as judge.sh does, reusing what
+	compiled before if given a cache, see compile.c; the
+	compiler speaks to stderr. It exits with 0 if the
+	source compiled, else with its verdict, see common.h.
+
+	build [-C cache_dir] [-B cache_mb] source_file exec_file
+	build -C cache_dir -r		how the cache does
+*/
+
+#include "common.h"
+#include "compile.h"
+
+#define USAGE "Usage: build [-C cache_dir] [-B cache_mb] source_file exec_file | -C cache_dir -r"
+
+int main(int argc, char *argv[]) {
+	int opt, mb, fd, c, result, reporting = 0;
+	const char *dir = NULL;
+	size_t bytes = COMPILE_CACHE_BYTES;
+	char log[] = "/tmp/build.XXXXXX";
+	FILE *fp;
+
+	while (-1 != (opt = getopt(argc, argv, "C:B:r")))
+		switch (opt) {
+			case 'C':
+				dir = optarg;
+				break;
+			case 'B':
+				if ((mb = atoi(optarg)) < 1)
+					EXIT_MSG(USAGE, EXIT_FAILURE);
+				bytes = (size_t)mb << 20;
+				break;
+			case 'r':
+				reporting = 1;
+				break;
+			default:
+				EXIT_MSG(USAGE, EXIT_FAILURE);
+		}
+	if (dir && -1 == compile_cache(dir, bytes))
+		EXIT_MSG("compile_cache() Failed", SYSTEM_ERROR);
+	if (reporting) {
+		if (!dir || argc != optind)
+			EXIT_MSG(USAGE, EXIT_FAILURE);
+		compile_report(stdout);
+		return EXIT_SUCCESS;
+	}
+	if (2 != argc - optind)
+		EXIT_MSG(USAGE, EXIT_FAILURE);
+
+	/* the diagnostics go to a file first, as they may be kept */
+	if (-1 == (fd = mkstemp(log)))
+		EXIT_MSG("mkstemp() Failed", SYSTEM_ERROR);
+	close(fd);
+	result = compile(argv[optind], argv[optind + 1], log);
+	if ((fp = fopen(log, "r"))) {
+		while (EOF != (c = getc(fp)))
+			putc(c, stderr);
+		fclose(fp);
+	}
+	unlink(log);
+	return result;
+}
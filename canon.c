@@ -0,0 +1,315 @@
+/*
+	Expected outputs are canonicalized once at ingest,
+	so judging a candidate is a single pass over its
+	output: lines are cut with memchr() and checked
+	against the canonical text with memcmp().
+*/
+
+#include "common.h"
+#include "mfile.h"
+#include "canon.h"
+#include "hash.h"
+
+#define CANON_MAGIC "CAN2"
+
+/* blanks that are dropped at the end of a line */
+static inline int isTrailing(char c) {
+	return ' ' == c || '\t' == c || '\r' == c || '\v' == c || '\f' == c;
+}
+
+/*
+	length of a line without its trailing blanks
+*/
+size_t canon_trim(const char *line, size_t len) {
+	while (len && isTrailing(line[len - 1]))
+		--len;
+	return len;
+}
+
+/*
+	write the canonical form of src into dst, which must
+	have room for len + 1 bytes, return the written size
+*/
+size_t canon_build(const char *src, size_t len, char *dst, unsigned *flags) {
+	const char *p = src, *end = src + len;
+	const char *nl, *eol, *cut;
+	size_t n = 0, pending = 0;
+	unsigned quirks = 0;
+
+	if (len && '\n' != end[-1])
+		quirks |= CANON_NO_FINAL_NEWLINE;
+
+	while (p < end) {
+		nl = memchr(p, '\n', end - p);
+		eol = nl ? nl : end;
+
+		if (eol > p && '\r' == eol[-1]) {
+			quirks |= CANON_CRLF;
+			--eol;
+		}
+		for (cut = eol; cut > p && isTrailing(cut[-1]); --cut)
+			;
+		if (cut < eol)
+			quirks |= CANON_TRAILING_SPACE;
+
+		/* empty lines are kept only if something follows */
+		if (cut == p) {
+			++pending;
+		} else {
+			memset(dst + n, '\n', pending);
+			n += pending;
+			pending = 0;
+			memcpy(dst + n, p, cut - p);
+			n += cut - p;
+			dst[n++] = '\n';
+		}
+		p = nl ? nl + 1 : end;
+	}
+	if (pending)
+		quirks |= CANON_TRAILING_BLANK;
+
+	if (flags)
+		*flags = quirks;
+	return n;
+}
+
+/*
+	move a reference past the next canonical line:
+	the pending empty lines, then line[0, n) and '\n'
+*/
+static inline int advance(const struct canon *ref, size_t *pos,
+	size_t pending, const char *line, size_t n) {
+	const char *text = ref->text;
+	size_t k = *pos;
+
+	if (ref->len - k < pending + n + 1)
+		return 0;
+	for ( ; pending; --pending)
+		if ('\n' != text[k++])
+			return 0;
+	if (0 != memcmp(text + k, line, n) || '\n' != text[k + n])
+		return 0;
+	*pos = k + n + 1;
+	return 1;
+}
+
+/*
+	refine where a reference diverged to the first
+	differing byte, both sides start at a line there
+*/
+static void pinpoint(const struct canon *ref, const char *usr, size_t usr_len,
+	size_t u, size_t e, struct mismatch *m) {
+	while (u < usr_len && e < ref->len && usr[u] == ref->text[e])
+		++u, ++e;
+	m->usr = u;
+	m->exp = e;
+}
+
+/*
+	test which of n references usr canonicalizes to,
+	walking usr once without materializing its form;
+	references are dropped as soon as they diverge.
+	Return the first one matched, or -1, and set best
+	to the one that matched the longest prefix and m
+	to where that one departs from usr.
+*/
+int canon_match_any(const struct canon *ref, int n,
+	const char *usr, size_t usr_len, int *best, struct mismatch *m) {
+	const char *p = usr, *end = usr + usr_len;
+	const char *nl, *eol, *cut, *empty = NULL;
+	size_t pos[CANON_MAX_REFS], stop[CANON_MAX_REFS], pending = 0;
+	unsigned live = 0;
+	int i;
+
+	*best = 0;
+	for (i = 0; i < n; ++i) {
+		/* already canonical and byte-identical */
+		if (usr_len == ref[i].len && 0 == memcmp(ref[i].text, usr, usr_len))
+			return *best = i;
+		pos[i] = 0;
+		stop[i] = usr_len;
+		live |= 1U << i;
+	}
+
+	while (p < end && live) {
+		nl = memchr(p, '\n', end - p);
+		eol = nl ? nl : end;
+		for (cut = eol; cut > p && isTrailing(cut[-1]); --cut)
+			;
+
+		if (cut == p) {
+			if (0 == pending++)
+				empty = p;
+		} else {
+			for (i = 0; i < n; ++i)
+				if (live & 1U << i && !advance(&ref[i], &pos[i], pending, p, cut - p)) {
+					live &= ~(1U << i);
+					stop[i] = (pending ? empty : p) - usr;
+				}
+			pending = 0;
+		}
+		p = nl ? nl + 1 : end;
+	}
+
+	for (i = 0; i < n; ++i) {
+		if (live & 1U << i && pos[i] == ref[i].len)
+			return *best = i;
+		if (pos[i] > pos[*best])
+			*best = i;
+	}
+	pinpoint(&ref[*best], usr, usr_len, stop[*best], pos[*best], m);
+	return -1;
+}
+
+/*
+	"dir/0.out" -> "dir/0.canon"
+	"dir/0.alt1.out" -> "dir/0.alt1.canon"
+*/
+static void canonPath(char *path, size_t size, const char *out) {
+	size_t len = strlen(out);
+
+	if (len >= 4 && 0 == strcmp(out + len - 4, ".out"))
+		len -= 4;
+	snprintf(path, size, "%.*s.canon", (int)len, out);
+}
+
+static int64_t mtimeOf(const struct stat *st) {
+	return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+/*
+	load the canonical form of an expected output, from
+	its ingested .canon file if that is up to date, else
+	by canonicalizing the .out on the fly
+*/
+int canon_load(struct canon *c, const char *out) {
+	char path[PATH_MAX];
+	struct stat st;
+	struct mfile mf;
+	const struct canon_header *hdr;
+
+	memset(c, 0, sizeof *c);
+
+	if (-1 == stat(out, &st))
+		return -1;
+
+	canonPath(path, sizeof path, out);
+	if (0 == mfile_open(&mf, path)) {
+		hdr = (const struct canon_header *)mf.mem;
+		if (mf.len >= sizeof *hdr
+			&& 0 == memcmp(hdr->magic, CANON_MAGIC, 4)
+			&& hdr->size == (uint64_t)st.st_size
+			&& hdr->mtime == mtimeOf(&st)) {
+			c->map = (void *)mf.mem;
+			c->map_len = mf.len;
+			c->text = mf.mem + sizeof *hdr;
+			c->len = mf.len - sizeof *hdr;
+			c->flags = hdr->flags;
+			c->hash = hdr->hash;
+			return 0;
+		}
+		/* stale, ingest it again */
+		mfile_close(&mf);
+	}
+
+	if (-1 == mfile_open(&mf, out))
+		return -1;
+	if (NULL == (c->buf = malloc(mf.len + 1))) {
+		mfile_close(&mf);
+		return -1;
+	}
+	c->len = canon_build(mf.mem, mf.len, c->buf, &c->flags);
+	c->text = c->buf;
+	c->hash = hash64(c->text, c->len, 0);
+	return mfile_close(&mf);
+}
+
+/*
+	"dir/0.out" and k > 0 -> "dir/0.altk.out"
+*/
+void canon_alt_path(char *path, size_t size, const char *out, int k) {
+	size_t len = strlen(out);
+
+	if (len >= 4 && 0 == strcmp(out + len - 4, ".out"))
+		len -= 4;
+	if (0 == k)
+		snprintf(path, size, "%s", out);
+	else
+		snprintf(path, size, "%.*s.alt%d.out", (int)len, out, k);
+}
+
+/*
+	load an expected output together with all of its
+	accepted alternatives, return how many there are
+*/
+int canon_load_refs(struct canon *ref, const char *out) {
+	char path[PATH_MAX];
+	int n;
+
+	if (-1 == canon_load(&ref[0], out))
+		return -1;
+
+	for (n = 1; n < CANON_MAX_REFS; ++n) {
+		canon_alt_path(path, sizeof path, out, n);
+		if (-1 == access(path, F_OK))
+			break;
+		if (-1 == canon_load(&ref[n], path)) {
+			while (n--)
+				canon_free(&ref[n]);
+			return -1;
+		}
+	}
+	return n;
+}
+
+void canon_free(struct canon *c) {
+	if (c->map)
+		munmap(c->map, c->map_len);
+	free(c->buf);
+	memset(c, 0, sizeof *c);
+}
+
+/*
+	store the canonical form of out next to it,
+	return its quirk flags, or -1 on failure
+*/
+int canon_ingest(const char *out) {
+	char path[PATH_MAX], temp[PATH_MAX + 8];
+	struct stat st;
+	struct mfile mf;
+	struct canon_header hdr;
+	char *buf;
+	size_t len;
+	int fd, ok;
+
+	if (-1 == stat(out, &st) || -1 == mfile_open(&mf, out))
+		return -1;
+	if (NULL == (buf = malloc(mf.len + 1))) {
+		mfile_close(&mf);
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, CANON_MAGIC, 4);
+	len = canon_build(mf.mem, mf.len, buf, &hdr.flags);
+	hdr.hash = hash64(buf, len, 0);
+	hdr.size = st.st_size;
+	hdr.mtime = mtimeOf(&st);
+	mfile_close(&mf);
+
+	/* write aside and rename, so a judge never sees half of it */
+	canonPath(path, sizeof path, out);
+	snprintf(temp, sizeof temp, "%s.tmp", path);
+	if ((fd = creat(temp, 0644)) < 0) {
+		free(buf);
+		return -1;
+	}
+	ok = sizeof hdr == write(fd, &hdr, sizeof hdr)
+		&& (ssize_t)len == write(fd, buf, len);
+	free(buf);
+	if (-1 == close(fd) || !ok || -1 == rename(temp, path)) {
+		unlink(temp);
+		return -1;
+	}
+	return hdr.flags;
+}
@@ -0,0 +1,58 @@
+#ifndef CANON_H
+#define CANON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+	Canonical form of an output: every line stripped of
+	trailing blanks (CR included), trailing empty lines
+	dropped, and each remaining line ended by one '\n'.
+*/
+
+/* quirks of the original expected output, kept by ingest */
+enum {
+	CANON_CRLF = 1 << 0,			/* "\r\n" line endings */
+	CANON_TRAILING_SPACE = 1 << 1,		/* blanks before end of line */
+	CANON_NO_FINAL_NEWLINE = 1 << 2,	/* last line not terminated */
+	CANON_TRAILING_BLANK = 1 << 3,		/* empty lines at the end */
+};
+
+/* an expected output and its alternatives, "N.altK.out" */
+#define CANON_MAX_REFS 16
+
+/* on-disk header of an ingested "N.canon" file */
+struct canon_header {
+	char magic[4];		/* "CAN2", "CANO" had no hash */
+	uint32_t flags;		/* CANON_* quirks */
+	uint64_t size;		/* size of the original .out */
+	int64_t mtime;		/* mtime of the original .out, in ns */
+	uint64_t hash;		/* hash64() of the canonical text */
+};
+
+/* canonical text of an expected output */
+struct canon {
+	const char *text;
+	size_t len;
+	unsigned flags;
+	uint64_t hash;		/* content key for resident caches */
+
+	/* backing storage, either mapped or allocated */
+	void *map;
+	size_t map_len;
+	char *buf;
+};
+
+size_t canon_trim(const char *line, size_t len);
+size_t canon_build(const char *src, size_t len, char *dst, unsigned *flags);
+struct mismatch;
+int canon_match_any(const struct canon *ref, int n,
+	const char *usr, size_t usr_len, int *best, struct mismatch *m);
+
+int canon_load(struct canon *c, const char *out);
+int canon_load_refs(struct canon *ref, const char *out);
+void canon_alt_path(char *path, size_t size, const char *out, int k);
+void canon_free(struct canon *c);
+int canon_ingest(const char *out);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef CHECKER_H
+#define CHECKER_H
+
+/*
+	Special judge ABI, for problems with more than one
+	valid answer. A checker is a shared object, built by
+
+		gcc -shared -fPIC -o checker.so checker.c
+
+	and named in the problem.conf as "checker = checker.so".
+	The judge loads it once per problem and calls check()
+	once per test case on the already mapped files:
+
+		int init(const char *problem);
+			0 on success, problem is the problem folder
+
+		int check(struct span input, struct span expected,
+			struct span output, char *message, size_t size);
+			one of CHECKER_*, message is an optional hint
+
+		void fini(void);
+
+	Unless "checker_trusted = yes", it runs in a helper
+	process that may only open files to read them while
+	it is loaded and in init(); after that it may not
+	open files, fork or exec: all it can do is compute
+	on the spans it is given.
+*/
+
+#include <stddef.h>
+
+/* a piece of a mapped file, not NUL-terminated */
+struct span {
+	const char *ptr;
+	size_t len;
+};
+
+/* verdicts a checker may give */
+enum {
+	CHECKER_ACCEPTED,
+	CHECKER_WRONG_ANSWER,
+	CHECKER_PRESENTATION_ERROR,
+	CHECKER_FAILED,		/* the checker itself went wrong */
+};
+
+typedef int checker_init_t(const char *problem);
+typedef int checker_check_t(struct span input, struct span expected,
+	struct span output, char *message, size_t size);
+typedef void checker_fini_t(void);
+
+#endif
@@ -3,16 +3,20 @@
 #include <sys/syscall.h>
 #include <sys/ptrace.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/user.h>
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <sys/reg.h>
 
+#include <limits.h>
 #include <libgen.h>
 #include <dirent.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
 #include <error.h>
 #include <ctype.h>
 #include <fcntl.h>
@@ -36,9 +40,8 @@
 /* total length of time that one program can possess */
 #define MAX_TIME (1500)
 
-/* restrict maximum lines of printed output */
+/* restrict maximum size of printed output */
 #define MAX_OUTPUT (1<<25)
-#define MAX_LINE_LEN 80
 
 /* in case of error occurence */
 #define EXIT_MSG(msg, res) \
@@ -57,35 +60,20 @@ enum {
 	ACCEPTED,
 };
 
-/* allowed system call list */
-const int strace[] = {
-	SYS_lseek,
-	SYS_mmap,
-	SYS_open,
-	SYS_read,
-	SYS_write,
-	SYS_close,
-	SYS_access,
-	SYS_mprotect,
-	SYS_brk,
-	SYS_uname,
-	SYS_fstat,
-	SYS_execve,
-	SYS_readlink,
-	SYS_arch_prctl,
-	SYS_munmap,
-	SYS_exit_group,
-	-1, /* the end flag */
+/* where a candidate output first departs from the expected one */
+struct mismatch {
+	size_t usr;	/* byte offset into the candidate output */
+	size_t exp;	/* byte offset into the expected output */
 };
 
-/* allowed library mapping list */
-const char *ltrace[] = {
-	"/etc/ld.so.cache",
-	/* for C */
-	"/lib/x86_64-linux-gnu/libc.so.6", /* in this case it's on x86-64 */
-	"/lib/x86_64-linux-gnu/libm.so.6",
-	/* for C++ */
-	"/lib/x86_64-linux-gnu/libgcc_s.so.1",
-	"/usr/lib/x86_64-linux-gnu/libstdc++.so.6",
-	NULL, /* the end flag */
-};
+/* allowed system call list, see policy.c */
+extern const int strace[];
+
+/* allowed library mapping list, see policy.c */
+extern const char *ltrace[];
+
+/* allowed system call list of a sandboxed checker, see policy.c */
+extern const int checker_strace[];
+
+/* what it may add while loading, see policy.c */
+extern const int checker_load_strace[];
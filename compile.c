@@ -0,0 +1,518 @@
+/*
+	The compiler, for the judges that build a
+	submission themselves, judge.sh through build.c.
+
+	Given a cache directory, what compiles is kept there
+	under two keys: that of the source as compile_key()
+	has it, along with the files it includes by "name",
+	and that of the source as the preprocessor leaves
+	it, so that a source differing only in its comments
+	or layout is not compiled again either. The
+	compiler itself is in both, by where it lies, its
+	size and time, so that another version of it misses.
+	The diagnostics of a source that does not compile are
+	kept as well, under its key and its path, since they
+	name it. Entries are spread over 256 directories,
+	each kept within its share of the budget by dropping
+	the least recently used; the counts of hits and
+	misses are in the file counts, for all that use it.
+*/
+
+#include "common.h"
+#include "compile.h"
+#include "mfile.h"
+#include "hash.h"
+
+#include <sys/sendfile.h>
+#include <sys/file.h>
+#include <spawn.h>
+
+/* the most of a preprocessed source that is hashed */
+#define COMPILE_PREPROCESSED (1 << 26)
+
+/* the most files a source may include by "name" and be keyed */
+#define COMPILE_INCLUDES 64
+
+extern char **environ;
+
+/* what the counts file holds */
+enum { HITS, PREPROCESSED, ERRORS, COMPILED, COUNTS };
+
+static struct {
+	char dir[PATH_MAX];
+	size_t bytes;
+} cache;
+
+/*
+	the command that compiles source, argv[0] its
+	compiler; NULL for a source of another kind
+*/
+static char **command(const char *source, const char *bin, char *argv[8]) {
+	const char *suffix = strrchr(source, '.');
+	const char *cc = getenv("CC"), *cxx = getenv("CXX");
+
+	argv[1] = "-o";
+	argv[2] = (char *)bin;
+	argv[3] = "-Wall";
+	if (suffix && 0 == strcmp(suffix, ".c")) {
+		argv[0] = (char *)(cc ? cc : "clang");
+		argv[4] = "-lm";
+		argv[5] = "-std=c11";
+		argv[6] = (char *)source;
+		argv[7] = NULL;
+	} else if (suffix && 0 == strcmp(suffix, ".cpp")) {
+		argv[0] = (char *)(cxx ? cxx : "clang++");
+		argv[4] = "-std=c++11";
+		argv[5] = (char *)source;
+		argv[6] = NULL;
+	} else
+		return NULL;
+	return argv;
+}
+
+/*
+	what tells one compiler from another: where it lies
+	along PATH, its size and its time
+*/
+static uint64_t compiler(const char *name, uint64_t h) {
+	char path[PATH_MAX], *dirs, *dir, *next;
+	const char *env = getenv("PATH");
+	struct stat st;
+	int found = 0;
+
+	if (strchr(name, '/'))
+		found = sizeof path > snprintf(path, sizeof path, "%s", name) && 0 == stat(path, &st);
+	else if (env && (dirs = strdup(env))) {
+		for (dir = strtok_r(dirs, ":", &next); dir && !found; dir = strtok_r(NULL, ":", &next))
+			found = sizeof path > snprintf(path, sizeof path, "%s/%s", dir, name)
+				&& 0 == stat(path, &st) && S_ISREG(st.st_mode) && 0 == access(path, X_OK);
+		free(dirs);
+	}
+	if (!found)
+		return h;
+	h = hash64(path, strlen(path), h);
+	h = hash64(&st.st_size, sizeof st.st_size, h);
+	return hash64(&st.st_mtim, sizeof st.st_mtim, h);
+}
+
+static int run(char *argv[], const char *log) {
+	int status;
+	pid_t pid;
+	posix_spawn_file_actions_t actions;
+
+	if (posix_spawn_file_actions_init(&actions))
+		return SYSTEM_ERROR;
+	if (posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0)
+		|| posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, log,
+			O_WRONLY | O_CREAT | O_TRUNC, 0644)
+		|| posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ)) {
+		posix_spawn_file_actions_destroy(&actions);
+		return SYSTEM_ERROR;
+	}
+	posix_spawn_file_actions_destroy(&actions);
+
+	if (-1 == waitpid(pid, &status, 0))
+		return SYSTEM_ERROR;
+	return WIFEXITED(status) && 0 == WEXITSTATUS(status) ? EXIT_SUCCESS : COMPILE_ERROR;
+}
+
+/*
+	the key of source as the preprocessor leaves it,
+	comments and line breaks gone; 0 if it does not
+	preprocess
+*/
+static uint64_t preprocessed(char *const argv[]) {
+	char *pp[12], *text = NULL, *more;
+	size_t len = 0, cap = 0;
+	int i, n = 0, status, fd[2];
+	ssize_t got = 0;
+	uint64_t h = 0;
+	pid_t pid;
+	posix_spawn_file_actions_t actions;
+
+	/* the command, with -E -P for -o bin */
+	pp[n++] = argv[0];
+	pp[n++] = "-E";
+	pp[n++] = "-P";
+	for (i = 3; argv[i]; ++i)
+		pp[n++] = argv[i];
+	pp[n] = NULL;
+
+	if (-1 == pipe2(fd, O_CLOEXEC))
+		return 0;
+	if (posix_spawn_file_actions_init(&actions)) {
+		close(fd[0]);
+		close(fd[1]);
+		return 0;
+	}
+	if (posix_spawn_file_actions_adddup2(&actions, fd[1], STDOUT_FILENO)
+		|| posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0)
+		|| posix_spawnp(&pid, pp[0], &actions, NULL, pp, environ)) {
+		posix_spawn_file_actions_destroy(&actions);
+		close(fd[0]);
+		close(fd[1]);
+		return 0;
+	}
+	posix_spawn_file_actions_destroy(&actions);
+	close(fd[1]);
+
+	/* hashed whole, so that it is the same however it is read */
+	for ( ; ; len += got) {
+		if (len == cap) {
+			if (cap >= COMPILE_PREPROCESSED
+				|| NULL == (more = realloc(text, cap = 2 * cap + (1 << 16))))
+				break;
+			text = more;
+		}
+		if ((got = read(fd[0], text + len, cap - len)) <= 0)
+			break;
+	}
+	close(fd[0]);
+	if (-1 != waitpid(pid, &status, 0) && WIFEXITED(status) && 0 == WEXITSTATUS(status)
+		&& 0 == got) {
+		/* the flags, but not where the source lies */
+		for (i = 3; argv[i + 1]; ++i)
+			h = hash64(argv[i], strlen(argv[i]), h + 1);
+		h = hash64(text, len, compiler(argv[0], h) ^ 2);
+		h = h ? h : 1;
+	}
+	free(text);
+	return h;
+}
+
+static int entry(char *path, size_t size, uint64_t key) {
+	return size > snprintf(path, size, "%s/%02x/%016llx", cache.dir,
+		(unsigned)(key >> 56), (unsigned long long)key) ? 0 : -1;
+}
+
+static int copy(const char *from, const char *to, mode_t mode) {
+	struct stat st;
+	off_t off = 0;
+	int in, out, result = 0;
+
+	if (-1 == (in = open(from, O_RDONLY | O_CLOEXEC)))
+		return -1;
+	if (-1 == fstat(in, &st)
+		|| -1 == (out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode))) {
+		close(in);
+		return -1;
+	}
+	while (off < st.st_size)
+		if (sendfile(out, in, &off, st.st_size - off) <= 0) {
+			result = -1;
+			break;
+		}
+	close(in);
+	return close(out) || result ? -1 : 0;
+}
+
+/*
+	the entry of key into to, linked if it may be; it
+	is the most recently used from now on
+*/
+static int fetch(uint64_t key, const char *to, mode_t mode, int linked) {
+	char path[PATH_MAX];
+
+	if (-1 == entry(path, sizeof path, key) || -1 == access(path, F_OK))
+		return -1;
+	if (linked)
+		unlink(to);
+	if ((!linked || -1 == link(path, to)) && -1 == copy(path, to, mode))
+		return -1;
+	utimensat(AT_FDCWD, path, NULL, 0);
+	return 0;
+}
+
+static int compareTime(const void *a, const void *b) {
+	const struct timespec *x = a, *y = b;
+
+	if (x->tv_sec != y->tv_sec)
+		return x->tv_sec < y->tv_sec ? -1 : 1;
+	return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+/*
+	the directory of an entry within its share of the
+	budget, the least recently used going first
+*/
+static void evict(const char *dir) {
+	struct { struct timespec used; off_t size; char name[24]; } *e = NULL, *more;
+	char path[PATH_MAX];
+	struct dirent *d;
+	struct stat st;
+	size_t total = 0;
+	int i, n = 0, cap = 0;
+	DIR *dp;
+
+	if (NULL == (dp = opendir(dir)))
+		return;
+	while ((d = readdir(dp))) {
+		if ('.' == *d->d_name || strlen(d->d_name) >= sizeof e->name
+			|| sizeof path <= snprintf(path, sizeof path, "%s/%s", dir, d->d_name)
+			|| -1 == stat(path, &st))
+			continue;
+		if (n == cap) {
+			if (NULL == (more = realloc(e, (cap = 2 * cap + 16) * sizeof *e)))
+				break;
+			e = more;
+		}
+		e[n].used = st.st_mtim;
+		e[n].size = st.st_size;
+		strcpy(e[n].name, d->d_name);
+		total += e[n++].size;
+	}
+	closedir(dp);
+	if (total > cache.bytes / 256) {
+		qsort(e, n, sizeof *e, compareTime);
+		for (i = 0; i < n && total > cache.bytes / 256; ++i)
+			if (sizeof path > snprintf(path, sizeof path, "%s/%s", dir, e[i].name)
+				&& 0 == unlink(path))
+				total -= e[i].size;
+	}
+	free(e);
+}
+
+/*
+	from kept under key, written aside and renamed so
+	that it is never seen in part
+*/
+static void store(uint64_t key, const char *from, mode_t mode) {
+	char path[PATH_MAX], tmp[PATH_MAX];
+	int fd;
+
+	if (!key || -1 == entry(path, sizeof path, key)
+		|| sizeof tmp <= snprintf(tmp, sizeof tmp, "%s/%02x", cache.dir, (unsigned)(key >> 56))
+		|| (-1 == mkdir(tmp, 0755) && EEXIST != errno))
+		return;
+	evict(tmp);
+	if (sizeof tmp <= snprintf(tmp, sizeof tmp, "%s/%02x/.%016llx.XXXXXX", cache.dir,
+		(unsigned)(key >> 56), (unsigned long long)key)
+		|| -1 == (fd = mkstemp(tmp)))
+		return;
+	close(fd);
+	if (-1 == copy(from, tmp, mode) || -1 == chmod(tmp, mode) || -1 == rename(tmp, path))
+		unlink(tmp);
+}
+
+static void count(int what) {
+	char path[PATH_MAX];
+	int64_t n[COUNTS] = { 0 };
+	int fd;
+
+	if (sizeof path <= snprintf(path, sizeof path, "%s/counts", cache.dir)
+		|| -1 == (fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)))
+		return;
+	if (0 == flock(fd, LOCK_EX)) {
+		if (pread(fd, n, sizeof n, 0) < 0)
+			memset(n, 0, sizeof n);
+		n[what]++;
+		if (sizeof n != pwrite(fd, n, sizeof n, 0))
+			fprintf(stderr, "%s: write Failed\n", path);
+	}
+	close(fd);
+}
+
+/*
+	keep what compiles in dir, within about bytes;
+	-1 if dir cannot be made
+*/
+int compile_cache(const char *dir, size_t bytes) {
+	if (sizeof cache.dir <= snprintf(cache.dir, sizeof cache.dir, "%s", dir)
+		|| (-1 == mkdir(dir, 0755) && EEXIST != errno)) {
+		*cache.dir = '\0';
+		return -1;
+	}
+	cache.bytes = bytes;
+	return 0;
+}
+
+/*
+	compile source into bin the way judge.sh does, the
+	compiler speaking to log; a source of another kind
+	is taken to be an executable already
+*/
+int compile(const char *source, const char *bin, const char *log) {
+	char *argv[8], path[PATH_MAX];
+	uint64_t direct, failed, pre = 0;
+	struct stat st;
+	int result;
+
+	if (NULL == command(source, bin, argv)) {
+		if (NULL == realpath(source, path) || -1 == symlink(path, bin))
+			return SYSTEM_ERROR;
+		return EXIT_SUCCESS;
+	}
+	if (!*cache.dir)
+		return run(argv, log);
+
+	/* without a direct key, the preprocessed one is left;
+	   diagnostics name the source, so they go by its path too */
+	direct = compile_key(source);
+	failed = direct ? hash64(source, strlen(source), direct ^ 3) : 0;
+	if (direct && 0 == fetch(direct, bin, 0755, 1)) {
+		count(HITS);
+		return EXIT_SUCCESS;
+	}
+	if (failed && 0 == fetch(failed, log, 0644, 0)) {
+		count(ERRORS);
+		return COMPILE_ERROR;
+	}
+	if ((pre = preprocessed(argv)) && 0 == fetch(pre, bin, 0755, 1)) {
+		store(direct, bin, 0755);
+		count(PREPROCESSED);
+		return EXIT_SUCCESS;
+	}
+
+	result = run(argv, log);
+	if (EXIT_SUCCESS == result) {
+		store(direct, bin, 0755);
+		store(pre, bin, 0755);
+	} else if (COMPILE_ERROR == result && 0 == stat(log, &st) && S_ISREG(st.st_mode))
+		store(failed, log, 0644);
+	count(COMPILED);
+	return result;
+}
+
+/*
+	the hits and misses of the cache, by all that use
+	it, and what it holds
+*/
+void compile_report(FILE *fp) {
+	char path[PATH_MAX];
+	int64_t n[COUNTS] = { 0 }, total;
+	long entries = 0;
+	double bytes = 0;
+	struct dirent *d;
+	struct stat st;
+	int fd, i;
+	DIR *dp;
+
+	if (!*cache.dir)
+		return;
+	if (sizeof path > snprintf(path, sizeof path, "%s/counts", cache.dir)
+		&& -1 != (fd = open(path, O_RDONLY | O_CLOEXEC))) {
+		if (0 != flock(fd, LOCK_SH) || pread(fd, n, sizeof n, 0) < 0)
+			memset(n, 0, sizeof n);
+		close(fd);
+	}
+	for (i = 0; i < 256; ++i) {
+		if (sizeof path <= snprintf(path, sizeof path, "%s/%02x", cache.dir, i)
+			|| NULL == (dp = opendir(path)))
+			continue;
+		while ((d = readdir(dp)))
+			if ('.' != *d->d_name && sizeof path > snprintf(path, sizeof path, "%s/%02x/%s",
+				cache.dir, i, d->d_name) && 0 == stat(path, &st)) {
+				entries++;
+				bytes += st.st_size;
+			}
+		closedir(dp);
+	}
+	total = n[HITS] + n[PREPROCESSED] + n[ERRORS] + n[COMPILED];
+	fprintf(fp, "compile cache: %lld hits, %lld by preprocessed source, %lld errors reused,"
+		" %lld compiled, %.1f%% hit rate, %ld entries in %.1fMB of %zuMB\n",
+		(long long)n[HITS], (long long)n[PREPROCESSED], (long long)n[ERRORS],
+		(long long)n[COMPILED], total ? 100.0 * (total - n[COMPILED]) / total : 0,
+		entries, bytes / (1 << 20), cache.bytes >> 20);
+}
+
+/* whether text names the file it is in, or the source */
+static int namesFile(const char *text, size_t len) {
+	return memmem(text, len, "__FILE__", 8) || memmem(text, len, "__BASE_FILE__", 13);
+}
+
+/*
+	fold into h the files that text, of the file at
+	path, includes by "name", as the preprocessor finds
+	them next to it, and what those include in turn;
+	one not there is left to the compiler, whose
+	headers go by its identity. 1 if one of them
+	names a file, as __FILE__ does, -1 for an include that
+	cannot be made out, by a macro say, or too many
+*/
+static int includes(const char *path, const char *text, size_t len, uint64_t *h, int *left) {
+	const char *p = text, *end = text + len, *q, *slash = strrchr(path, '/');
+	char name[PATH_MAX];
+	struct mfile mf;
+	int result, named = 0;
+
+	for ( ; p < end; p = (q = memchr(p, '\n', end - p)) ? q + 1 : end) {
+		/* # include, with blanks anywhere */
+		while (p < end && (' ' == *p || '\t' == *p))
+			++p;
+		if (p == end || '#' != *p)
+			continue;
+		while (++p < end && (' ' == *p || '\t' == *p))
+			;
+		if (end - p < 7 || memcmp(p, "include", 7))
+			continue;
+		for (p += 7; p < end && (' ' == *p || '\t' == *p); ++p)
+			;
+		if (p < end && '<' == *p)
+			continue;
+		if (p == end || '"' != *p++ || NULL == (q = memchr(p, '"', end - p))
+			|| memchr(p, '\n', q - p) || !*left)
+			return -1;
+
+		if ('/' == *p)
+			snprintf(name, sizeof name, "%.*s", (int)(q - p), p);
+		else if (sizeof name <= snprintf(name, sizeof name, "%.*s%.*s",
+			slash ? (int)(slash + 1 - path) : 0, path, (int)(q - p), p))
+			return -1;
+		--*left;
+		*h = hash64(p, q - p, *h + 4);
+		if (-1 == mfile_open(&mf, name))
+			continue;
+		*h = hash64(mf.mem, mf.len, *h);
+		named |= namesFile(mf.mem, mf.len);
+		result = includes(name, mf.mem, mf.len, h, left);
+		mfile_close(&mf);
+		if (-1 == result)
+			return -1;
+		named |= result;
+	}
+	return named;
+}
+
+/*
+	a key for what compiling source gives: the source,
+	with CRLF line ends and white space at the end let
+	go, the files it includes by "name", and the command
+	but for where its files are, unless one of them says
+	__FILE__; 0 if source cannot be read, or what it
+	includes cannot be made out
+*/
+uint64_t compile_key(const char *source) {
+	char *argv[8], *text, **arg;
+	struct mfile mf;
+	size_t i, n = 0;
+	uint64_t h = 0;
+	int left = COMPILE_INCLUDES, result;
+
+	if (-1 == mfile_open(&mf, source))
+		return 0;
+	if (NULL == (text = malloc(mf.len + 1))) {
+		mfile_close(&mf);
+		return 0;
+	}
+	for (i = 0; i < mf.len; ++i)
+		if ('\r' != mf.mem[i] || i + 1 == mf.len || '\n' != mf.mem[i + 1])
+			text[n++] = mf.mem[i];
+	result = includes(source, mf.mem, mf.len, &h, &left);
+	mfile_close(&mf);
+	while (n && isspace((unsigned char)text[n - 1]))
+		--n;
+
+	if (command(source, "", argv)) {
+		for (arg = argv; *arg; ++arg)
+			if (*arg != source)
+				h = hash64(*arg, strlen(*arg), h + 1);
+		h = compiler(argv[0], h);
+	}
+	if (1 == result || namesFile(text, n))
+		h = hash64(source, strlen(source), h + 5);
+	h = hash64(text, n, h ^ 1);
+	free(text);
+	if (-1 == result)
+		return 0;
+	return h ? h : 1;
+}
@@ -0,0 +1,15 @@
+#ifndef COMPILE_H
+#define COMPILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* what the compile cache keeps by default */
+#define COMPILE_CACHE_BYTES ((size_t)256 << 20)
+
+int compile_cache(const char *dir, size_t bytes);
+int compile(const char *source, const char *bin, const char *log);
+uint64_t compile_key(const char *source);
+void compile_report(FILE *fp);
+
+#endif
@@ -0,0 +1,204 @@
+/*
+	Weighted fair share of the judge among tenants,
+	users and the course sections they are in, so that
+	a student resubmitting in a loop, or a whole section
+	at its deadline, does not starve everyone else.
+
+	Each job is tagged when it is queued with a virtual
+	finish time, for its user and for its section alike:
+
+		F = max(V, F of the tenant) + cost / weight
+
+	and the larger of the two is its rank in the queue.
+	V is the tag of the job that last started to run.
+	A tenant with many jobs queued sees its tags run
+	ahead of V, and a newcomer goes before them; of two
+	otherwise equal jobs, the cheaper one goes first.
+
+	A job costs what the history of its problem says a
+	passing submission takes; a resubmission to the same
+	problem costs no more than the last one took, as
+	wrong ones tend to fail as fast again.
+*/
+
+#include <pthread.h>
+
+#include "common.h"
+#include "history.h"
+#include "fair.h"
+
+enum {
+	FAIR_USER,
+	FAIR_SECTION,
+};
+
+struct tenant {
+	int kind;
+	char name[64];
+	double weight, finish;
+
+	/* the problem of the last job, and how long it ran */
+	char last[PATH_MAX];
+	long last_ms;
+
+	/* from submission to the start of the run, in ms */
+	double latency[FAIR_SAMPLES];
+	long served;
+
+	struct tenant *next;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct tenant *tenants;
+static double vtime;
+
+static const char *kinds[] = {
+	[FAIR_USER] = "user",
+	[FAIR_SECTION] = "section",
+};
+
+/*
+	the tenant of that name, lock held; a stranger gets
+	a weight of 1, and is NULL only if out of memory
+*/
+static struct tenant *tenant(int kind, const char *name) {
+	struct tenant *t;
+
+	for (t = tenants; t; t = t->next)
+		if (kind == t->kind && 0 == strcmp(name, t->name))
+			return t;
+	if (NULL == (t = calloc(1, sizeof *t)))
+		return NULL;
+	t->kind = kind;
+	snprintf(t->name, sizeof t->name, "%s", name);
+	t->weight = 1;
+	t->last_ms = -1;
+	t->next = tenants;
+	tenants = t;
+	return t;
+}
+
+/*
+	read lines of "user NAME WEIGHT" and "section NAME
+	WEIGHT"; a missing file leaves everyone at 1
+*/
+int fair_weights(const char *path) {
+	char line[256], kind[16], name[64];
+	double weight;
+	int lineno = 0, result = 0;
+	struct tenant *t;
+	FILE *fp;
+
+	if (NULL == (fp = fopen(path, "r")))
+		return ENOENT == errno ? 0 : -1;
+	pthread_mutex_lock(&lock);
+	while (fgets(line, sizeof line, fp)) {
+		++lineno;
+		if (1 > sscanf(line, " %15[^# \t\n]", kind))
+			continue;
+		if (3 != sscanf(line, "%15s %63s %lf", kind, name, &weight) || weight <= 0
+			|| (strcmp(kind, kinds[FAIR_USER]) && strcmp(kind, kinds[FAIR_SECTION]))) {
+			fprintf(stderr, "%s:%d: bad weight\n", path, lineno);
+			result = -1;
+			continue;
+		}
+		t = tenant(strcmp(kind, kinds[FAIR_USER]) ? FAIR_SECTION : FAIR_USER, name);
+		if (t)
+			t->weight = weight;
+	}
+	pthread_mutex_unlock(&lock);
+	fclose(fp);
+	return result;
+}
+
+static double finish(struct tenant *t, double cost) {
+	if (!t)
+		return vtime;
+	t->finish = (t->finish > vtime ? t->finish : vtime) + cost / t->weight;
+	return t->finish;
+}
+
+/*
+	the rank of a job of user in section to folder
+*/
+double fair_tag(const char *user, const char *section, const char *folder) {
+	long cost = folder ? history_cost(folder) : -1;
+	struct tenant *u;
+	double fu, fs;
+
+	if (cost < 0)
+		cost = FAIR_COST;
+	pthread_mutex_lock(&lock);
+	u = tenant(FAIR_USER, user);
+	if (u && folder && u->last_ms >= 0 && u->last_ms < cost && 0 == strcmp(u->last, folder))
+		cost = u->last_ms;
+	cost += FAIR_COMPILE;
+	fu = finish(u, cost);
+	fs = finish(tenant(FAIR_SECTION, section), cost);
+	pthread_mutex_unlock(&lock);
+	return fu > fs ? fu : fs;
+}
+
+/*
+	the job of that rank starts to run
+*/
+void fair_start(double tag) {
+	pthread_mutex_lock(&lock);
+	if (tag > vtime)
+		vtime = tag;
+	pthread_mutex_unlock(&lock);
+}
+
+void fair_ran(const char *user, const char *folder, long ms) {
+	struct tenant *u;
+
+	pthread_mutex_lock(&lock);
+	if ((u = tenant(FAIR_USER, user))) {
+		snprintf(u->last, sizeof u->last, "%s", folder);
+		u->last_ms = ms;
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+static void sample(struct tenant *t, double ms) {
+	if (t)
+		t->latency[t->served++ % FAIR_SAMPLES] = ms;
+}
+
+void fair_waited(const char *user, const char *section, double ms) {
+	pthread_mutex_lock(&lock);
+	sample(tenant(FAIR_USER, user), ms);
+	sample(tenant(FAIR_SECTION, section), ms);
+	pthread_mutex_unlock(&lock);
+}
+
+static int compareDouble(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+	queueing latency percentiles of each tenant, over
+	its most recent jobs
+*/
+void fair_report(FILE *fp) {
+	double sorted[FAIR_SAMPLES];
+	struct tenant *t;
+	long n;
+
+	pthread_mutex_lock(&lock);
+	for (t = tenants; t; t = t->next) {
+		n = t->served < FAIR_SAMPLES ? t->served : FAIR_SAMPLES;
+		fprintf(fp, "%s %s: weight %g, %ld jobs", kinds[t->kind], t->name,
+			t->weight, t->served);
+		if (n) {
+			memcpy(sorted, t->latency, n * sizeof *sorted);
+			qsort(sorted, n, sizeof *sorted, compareDouble);
+			fprintf(fp, ", queued p50 %.1fms p90 %.1fms p99 %.1fms",
+				sorted[n / 2], sorted[n * 9 / 10], sorted[n * 99 / 100]);
+		}
+		fprintf(fp, "\n");
+	}
+	pthread_mutex_unlock(&lock);
+}
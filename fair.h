@@ -0,0 +1,25 @@
+#ifndef FAIR_H
+#define FAIR_H
+
+#include <stdio.h>
+
+/* weights of users and sections, in the spool */
+#define FAIR_WEIGHTS "weights"
+
+/* queueing latencies kept per tenant for the percentiles */
+#define FAIR_SAMPLES 1024
+
+/* what a job is taken to cost, in ms, without history */
+#define FAIR_COST 1000
+
+/* what compiling adds to any job, in ms */
+#define FAIR_COMPILE 200
+
+int fair_weights(const char *path);
+double fair_tag(const char *user, const char *section, const char *folder);
+void fair_start(double tag);
+void fair_ran(const char *user, const char *folder, long ms);
+void fair_waited(const char *user, const char *section, double ms);
+void fair_report(FILE *fp);
+
+#endif
@@ -0,0 +1,74 @@
+/*
+	MurmurHash64A by Austin Appleby, in the public domain;
+	fast, but not meant to withstand a chosen collision
+*/
+
+#include <sys/random.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "hash.h"
+#include "mfile.h"
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static uint64_t seed;
+
+uint64_t hash64(const void *key, size_t len, uint64_t seed) {
+	const uint64_t m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+	const unsigned char *p = key, *end = p + (len & ~(size_t)7);
+	uint64_t h = seed ^ (len * m), k;
+
+	for ( ; p != end; p += 8) {
+		memcpy(&k, p, 8);
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+		h ^= k;
+		h *= m;
+	}
+
+	switch (len & 7) {
+		case 7: h ^= (uint64_t)p[6] << 48;	/* fall through */
+		case 6: h ^= (uint64_t)p[5] << 40;	/* fall through */
+		case 5: h ^= (uint64_t)p[4] << 32;	/* fall through */
+		case 4: h ^= (uint64_t)p[3] << 24;	/* fall through */
+		case 3: h ^= (uint64_t)p[2] << 16;	/* fall through */
+		case 2: h ^= (uint64_t)p[1] << 8;	/* fall through */
+		case 1: h ^= (uint64_t)p[0];
+			h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+	return h;
+}
+
+static void pickSeed(void) {
+	if (sizeof seed != getrandom(&seed, sizeof seed, 0))
+		seed = (uint64_t)time(NULL) << 20 ^ (uint64_t)getpid();
+}
+
+/*
+	a random seed, fixed for the life of the process,
+	for hashes that must not be predictable outside
+*/
+uint64_t hash_seed(void) {
+	pthread_once(&once, pickSeed);
+	return seed;
+}
+
+/*
+	a file's contents folded into seed; a missing file
+	leaves it as it was
+*/
+uint64_t hash_file(const char *path, uint64_t seed) {
+	struct mfile mf;
+
+	if (-1 == mfile_open(&mf, path))
+		return seed;
+	seed = hash64(mf.mem, mf.len, seed ^ mf.len);
+	mfile_close(&mf);
+	return seed;
+}
@@ -0,0 +1,11 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t hash64(const void *key, size_t len, uint64_t seed);
+uint64_t hash_seed(void);
+uint64_t hash_file(const char *path, uint64_t seed);
+
+#endif
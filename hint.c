@@ -0,0 +1,72 @@
+/*
+	Turn the byte offsets where a comparator saw the
+	outputs part into line and column numbers, and show
+	those whole lines straight from the mapped buffers,
+	so there is no second pass over the files and no
+	line is ever cut short.
+*/
+
+#include "common.h"
+#include "hint.h"
+
+/*
+	the line holding buf[offset], offset may be len
+*/
+void hint_locate(const char *buf, size_t len, size_t offset, struct hint_line *l) {
+	const char *p = buf, *end = buf + offset, *nl;
+
+	l->lineno = 1;
+	l->start = buf;
+	while (p < end && (nl = memchr(p, '\n', end - p))) {
+		++l->lineno;
+		p = l->start = nl + 1;
+	}
+	l->column = offset - (l->start - buf) + 1;
+
+	nl = memchr(l->start, '\n', buf + len - l->start);
+	l->len = (nl ? nl : buf + len) - l->start;
+}
+
+/*
+	the lineno-th line, return 0 if there is none
+*/
+int hint_nth(const char *buf, size_t len, size_t lineno, struct hint_line *l) {
+	const char *p = buf, *end = buf + len, *nl;
+	size_t n;
+
+	for (n = 1; n < lineno; ++n) {
+		if (NULL == (nl = memchr(p, '\n', end - p)) || nl + 1 == end)
+			return 0;
+		p = nl + 1;
+	}
+	if (p == end)
+		return 0;
+
+	l->lineno = lineno;
+	l->column = 1;
+	l->start = p;
+	nl = memchr(p, '\n', end - p);
+	l->len = (nl ? nl : end) - p;
+	return 1;
+}
+
+/*
+	show the input line of the same number as the
+	output line, then both sides of the mismatch
+*/
+void hint_print(FILE *fp, const char *in, size_t in_len,
+	const char *exp, size_t exp_len, const char *usr, size_t usr_len,
+	const struct mismatch *m) {
+	struct hint_line input, output, expected;
+
+	hint_locate(usr, usr_len, m->usr, &output);
+	hint_locate(exp, exp_len, m->exp, &expected);
+
+	if (hint_nth(in, in_len, output.lineno, &input))
+		fprintf(fp, "Input(%zu):^%.*s$\n",
+			input.lineno, (int)input.len, input.start);
+	fprintf(fp, "Output(%zu:%zu):^%.*s$\n",
+		output.lineno, output.column, (int)output.len, output.start);
+	fprintf(fp, "Expected(%zu:%zu):^%.*s$\n",
+		expected.lineno, expected.column, (int)expected.len, expected.start);
+}
@@ -0,0 +1,23 @@
+#ifndef HINT_H
+#define HINT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* a line found in a buffer */
+struct hint_line {
+	size_t lineno;		/* from 1 */
+	size_t column;		/* from 1 */
+	const char *start;
+	size_t len;		/* without the '\n' */
+};
+
+void hint_locate(const char *buf, size_t len, size_t offset, struct hint_line *l);
+int hint_nth(const char *buf, size_t len, size_t lineno, struct hint_line *l);
+
+struct mismatch;
+void hint_print(FILE *fp, const char *in, size_t in_len,
+	const char *exp, size_t exp_len, const char *usr, size_t usr_len,
+	const struct mismatch *m);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+	What past submissions to a problem made of each of
+	its test cases: how often it failed them and how
+	long it ran. Tests that often fail, and fail fast,
+	are run first, for a wrong submission is then
+	rejected early; with several tests at once, the
+	long ones are started first, so none is left to
+	finish on its own at the end.
+
+	The statistics live in the problem folder, one line
+	per test case, under a flock() as judges of several
+	submissions may share them.
+*/
+
+#include <sys/file.h>
+
+#include "common.h"
+#include "judge.h"
+#include "history.h"
+
+struct rank {
+	int num;
+	double first, then;
+};
+
+static void load(FILE *fp, int total, struct history *h) {
+	char line[128];
+	long runs, failures, time;
+	int num;
+
+	while (fgets(line, sizeof line, fp))
+		if (4 == sscanf(line, "%d %ld %ld %ld", &num, &runs, &failures, &time)
+			&& num >= 0 && num < total && runs >= failures && failures >= 0) {
+			h[num].runs = runs;
+			h[num].failures = failures;
+			h[num].time = time;
+		}
+}
+
+static FILE *openStats(const char *folder, int flags, int how) {
+	char path[PATH_MAX];
+	int fd;
+	FILE *fp;
+
+	if (sizeof path <= snprintf(path, sizeof path, "%s/%s", folder, HISTORY_FILE))
+		return NULL;
+	if (-1 == (fd = open(path, flags | O_CLOEXEC, 0644)))
+		return NULL;
+	if (-1 == flock(fd, how) || NULL == (fp = fdopen(fd, O_RDONLY == flags ? "r" : "r+"))) {
+		close(fd);
+		return NULL;
+	}
+	return fp;
+}
+
+static int byRank(const void *a, const void *b) {
+	const struct rank *x = a, *y = b;
+
+	if (x->first != y->first)
+		return x->first < y->first ? 1 : -1;
+	if (x->then != y->then)
+		return x->then < y->then ? 1 : -1;
+	return x->num - y->num;
+}
+
+/*
+	fill order with the test numbers in the order to
+	run them; without any history, that is 0, 1, ...
+*/
+void history_order(const char *folder, int total, int jobs, int *order) {
+	int num, known = 0;
+	double rate, time, mean = 0;
+	struct history *h;
+	struct rank *r;
+	FILE *fp;
+
+	for (num = 0; num < total; ++num)
+		order[num] = num;
+	if (NULL == (fp = openStats(folder, O_RDONLY, LOCK_SH)))
+		return;
+	h = calloc(total, sizeof *h);
+	r = calloc(total, sizeof *r);
+	if (!h || !r) {
+		free(h);
+		free(r);
+		fclose(fp);
+		return;
+	}
+	load(fp, total, h);
+	fclose(fp);
+
+	for (num = 0; num < total; ++num)
+		if (h[num].runs) {
+			mean += (h[num].time + 1.0) / h[num].runs;
+			known++;
+		}
+	mean = known ? mean / known : 1;
+
+	for (num = 0; num < total; ++num) {
+		/* a test never run is a coin toss of the usual length */
+		rate = (h[num].failures + 1.0) / (h[num].runs + 2.0);
+		time = h[num].runs ? (h[num].time + 1.0) / h[num].runs : mean;
+		r[num].num = num;
+		if (jobs > 1) {
+			r[num].first = time;
+			r[num].then = rate;
+		} else {
+			r[num].first = rate / time;
+			r[num].then = rate;
+		}
+	}
+	qsort(r, total, sizeof *r, byRank);
+	for (num = 0; num < total; ++num)
+		order[num] = r[num].num;
+	free(h);
+	free(r);
+}
+
+/*
+	what a submission that passes every test case may
+	be expected to take, in ms; -1 with no history
+*/
+long history_cost(const char *folder) {
+	struct history h[HISTORY_TESTS];
+	long cost = 0, known = 0;
+	int num;
+	FILE *fp;
+
+	if (NULL == (fp = openStats(folder, O_RDONLY, LOCK_SH)))
+		return -1;
+	memset(h, 0, sizeof h);
+	load(fp, HISTORY_TESTS, h);
+	fclose(fp);
+
+	for (num = 0; num < HISTORY_TESTS; ++num)
+		if (h[num].runs) {
+			cost += h[num].time / h[num].runs;
+			known++;
+		}
+	return known ? cost : -1;
+}
+
+/*
+	add what s made of its test cases; those cut short
+	by an earlier failure tell nothing, nor do those
+	judged before
+*/
+void history_record(const char *folder, const struct suite *s) {
+	int num;
+	struct history *h;
+	const struct testcase *tc;
+	FILE *fp;
+
+	if (NULL == (fp = openStats(folder, O_RDWR | O_CREAT, LOCK_EX)))
+		return;
+	if (NULL == (h = calloc(s->total, sizeof *h))) {
+		fclose(fp);
+		return;
+	}
+	load(fp, s->total, h);
+
+	for (num = 0; num < s->total; ++num) {
+		tc = &s->tc[num];
+		if (!tc->result || tc->cancelled || tc->cached || SYSTEM_ERROR == tc->result)
+			continue;
+		h[num].runs++;
+		h[num].failures += ACCEPTED != tc->result;
+		h[num].time += tc->time;
+		if (h[num].runs > HISTORY_WINDOW) {
+			h[num].runs /= 2;
+			h[num].failures /= 2;
+			h[num].time /= 2;
+		}
+	}
+
+	rewind(fp);
+	fprintf(fp, "# test runs failures ms\n");
+	for (num = 0; num < s->total; ++num)
+		fprintf(fp, "%d %ld %ld %ld\n", num, h[num].runs, h[num].failures, h[num].time);
+	fflush(fp);
+	if (-1 == ftruncate(fileno(fp), ftell(fp)))
+		fprintf(stderr, "%s: ftruncate() Failed\n", HISTORY_FILE);
+	fclose(fp);
+	free(h);
+}
@@ -0,0 +1,25 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+/* the statistics of a problem, next to its test cases */
+#define HISTORY_FILE "stats"
+
+/* past this many runs of a test, older ones weigh half */
+#define HISTORY_WINDOW 1024
+
+/* test cases looked at for the cost of a problem */
+#define HISTORY_TESTS 256
+
+struct suite;
+
+/* how a test case fared over past submissions */
+struct history {
+	long runs, failures;
+	long time;		/* in ms, summed over the runs */
+};
+
+void history_order(const char *folder, int total, int jobs, int *order);
+long history_cost(const char *folder);
+void history_record(const char *folder, const struct suite *s);
+
+#endif
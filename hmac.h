@@ -0,0 +1,12 @@
+#ifndef HMAC_H
+#define HMAC_H
+
+#include <stddef.h>
+
+/* bytes of a digest */
+#define HMAC_SIZE 32
+
+void hmac_sha256(const void *key, size_t key_len, const void *msg, size_t len,
+	unsigned char digest[HMAC_SIZE]);
+
+#endif
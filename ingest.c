@@ -0,0 +1,46 @@
+/*
+	Canonicalize every expected output of a problem,
+	so that the judge checks answers with a memcmp().
+	Run it again whenever a .out file is changed;
+	a stale .canon is ignored by the judge anyway.
+*/
+
+#include "common.h"
+#include "canon.h"
+
+static int isOutput(const struct dirent *entry) {
+	size_t len = strlen(entry->d_name);
+
+	return len > 4 && 0 == strcmp(entry->d_name + len - 4, ".out");
+}
+
+int main(int argc, char *argv[]) {
+	int i, n, flags, result = EXIT_SUCCESS;
+	char path[PATH_MAX];
+	struct dirent **filename;
+
+	if (2 != argc)
+		EXIT_MSG("Usage: ingest problem_folder", EXIT_FAILURE);
+
+	n = scandir(argv[1], &filename, isOutput, alphasort);
+	if (n < 0)
+		EXIT_MSG("scandir() Failed", EXIT_FAILURE);
+
+	for (i = 0; i < n; ++i) {
+		snprintf(path, sizeof path, "%s/%s", argv[1], filename[i]->d_name);
+		free(filename[i]);
+
+		if (-1 == (flags = canon_ingest(path))) {
+			fprintf(stderr, "%s\tingest Failed\n", path);
+			result = EXIT_FAILURE;
+			continue;
+		}
+		printf("%s%s%s%s%s\n", path,
+			flags & CANON_CRLF ? " crlf" : "",
+			flags & CANON_TRAILING_SPACE ? " trailing-space" : "",
+			flags & CANON_NO_FINAL_NEWLINE ? " no-final-newline" : "",
+			flags & CANON_TRAILING_BLANK ? " trailing-blank-lines" : "");
+	}
+	free(filename);
+	return result;
+}
@@ -0,0 +1,378 @@
+/*
+	The journal of judged: a line for each job queued,
+	started and finished, appended as it happens.
+
+	queued ID USER SECTION SOURCE FOLDER NAME
+	started ID
+	finished ID
+
+	NAME is that of the job in the spool, "-" for one
+	from the socket. A thread of its own writes the lines
+	and syncs them, as many as have piled up since the
+	last sync at once, so that a busy judge syncs once
+	for many jobs rather than for each. A job from the
+	socket is only acknowledged once its line is synced,
+	and told an error if it could not be.
+
+	When judged starts, the jobs from the socket that
+	never finished are queued again; those of the spool
+	are still in it. The journal is first written anew
+	with only the jobs still pending, so that it only
+	grows for as long as judged runs.
+*/
+
+#include <pthread.h>
+#include <stdarg.h>
+
+#include "common.h"
+#include "mfile.h"
+#include "judged.h"
+#include "journal.h"
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t more, synced;
+	int fd, stopping;
+	pthread_t writer;
+
+	/* lines not yet written, and how many so far */
+	char *buf;
+	size_t len, cap;
+	unsigned long appended, written;
+
+	/* where the last write that failed ended */
+	unsigned long failed;
+	long failures;
+
+	long syncs;
+	double sync_ms[JOURNAL_SAMPLES];
+} journal = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.more = PTHREAD_COND_INITIALIZER,
+	.synced = PTHREAD_COND_INITIALIZER,
+	.fd = -1,
+};
+
+static double since(const struct timespec *t) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - t->tv_sec) * 1e3 + (now.tv_nsec - t->tv_nsec) / 1e6;
+}
+
+static int writeAll(int fd, const char *buf, size_t len) {
+	ssize_t n;
+
+	for ( ; len; buf += n, len -= n)
+		if ((n = write(fd, buf, len)) < 0)
+			return -1;
+	return 0;
+}
+
+static void append(const char *fmt, ...) {
+	char line[3 * PATH_MAX], *more;
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(line, sizeof line, fmt, ap);
+	va_end(ap);
+	if (n < 0 || n >= sizeof line)
+		return;
+
+	pthread_mutex_lock(&journal.lock);
+	if (-1 == journal.fd) {
+		pthread_mutex_unlock(&journal.lock);
+		return;
+	}
+	if (journal.len + n > journal.cap) {
+		if (NULL == (more = realloc(journal.buf, 2 * journal.cap + n))) {
+			pthread_mutex_unlock(&journal.lock);
+			fprintf(stderr, "journal Failed\n");
+			return;
+		}
+		journal.buf = more;
+		journal.cap = 2 * journal.cap + n;
+	}
+	memcpy(journal.buf + journal.len, line, n);
+	journal.len += n;
+	journal.appended++;
+	pthread_cond_signal(&journal.more);
+	pthread_mutex_unlock(&journal.lock);
+}
+
+/*
+	whatever piled up goes in one write and one sync;
+	what comes meanwhile waits for the next
+*/
+static void *writer(void *arg) {
+	char *buf = NULL, *spare;
+	size_t len, cap = 0, spare_cap;
+	unsigned long upto;
+	struct timespec start;
+	off_t end;
+	int ok;
+
+	for ( ; ; ) {
+		pthread_mutex_lock(&journal.lock);
+		while (!journal.len && !journal.stopping)
+			pthread_cond_wait(&journal.more, &journal.lock);
+		if (!journal.len) {
+			pthread_mutex_unlock(&journal.lock);
+			free(buf);
+			return NULL;
+		}
+		/* the buffers change hands, the sync is unlocked */
+		spare = buf;
+		spare_cap = cap;
+		buf = journal.buf;
+		cap = journal.cap;
+		len = journal.len;
+		upto = journal.appended;
+		journal.buf = spare;
+		journal.cap = spare_cap;
+		journal.len = 0;
+		pthread_mutex_unlock(&journal.lock);
+
+		/* a write cut short is cut off, not left torn */
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		end = lseek(journal.fd, 0, SEEK_END);
+		ok = -1 != end && 0 == writeAll(journal.fd, buf, len) && 0 == fdatasync(journal.fd);
+		if (!ok) {
+			fprintf(stderr, "journal write Failed\n");
+			if (-1 != end && ftruncate(journal.fd, end))
+				fprintf(stderr, "journal ftruncate() Failed\n");
+		}
+
+		pthread_mutex_lock(&journal.lock);
+		journal.sync_ms[journal.syncs++ % JOURNAL_SAMPLES] = since(&start);
+		journal.written = upto;
+		if (!ok) {
+			journal.failed = upto;
+			journal.failures++;
+		}
+		pthread_cond_broadcast(&journal.synced);
+		pthread_mutex_unlock(&journal.lock);
+	}
+}
+
+static int compareDouble(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static int compareLong(const void *a, const void *b) {
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+	the next whole line of a journal, NUL terminated; a
+	line torn by a crash is not
+*/
+static const char *nextLine(const struct mfile *mf, size_t *off, char *line, size_t size) {
+	const char *p = mf->mem + *off, *nl;
+
+	if (*off >= mf->len || NULL == (nl = memchr(p, '\n', mf->len - *off)))
+		return NULL;
+	*off += nl + 1 - p;
+	if (nl - p >= size)
+		*line = '\0';
+	else {
+		memcpy(line, p, nl - p);
+		line[nl - p] = '\0';
+	}
+	return p;
+}
+
+/*
+	the journal at path written anew with the queued
+	lines of the jobs that never finished, which are
+	handed back by their offsets
+*/
+static int compact(const char *path, const struct mfile *mf, long *last,
+	size_t **pending, int *npending) {
+	char tmp[PATH_MAX], line[3 * PATH_MAX], word[16];
+	long id, *done = NULL, *more;
+	size_t off, *offs;
+	const char *p;
+	int fd, dir, n = 0, cap = 0, result = 0;
+
+	/* what finished, first */
+	for (off = 0; nextLine(mf, &off, line, sizeof line); )
+		if (2 == sscanf(line, "%15s %ld", word, &id)) {
+			if (id > *last)
+				*last = id;
+			if (strcmp(word, "finished"))
+				continue;
+			if (n == cap) {
+				if (NULL == (more = realloc(done, (cap = 2 * cap + 64) * sizeof *done))) {
+					free(done);
+					return -1;
+				}
+				done = more;
+			}
+			done[n++] = id;
+		}
+	qsort(done, n, sizeof *done, compareLong);
+
+	*pending = NULL;
+	*npending = cap = 0;
+	if (sizeof tmp <= snprintf(tmp, sizeof tmp, "%s.tmp", path)
+		|| -1 == (fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))) {
+		free(done);
+		return -1;
+	}
+	for (off = 0; (p = nextLine(mf, &off, line, sizeof line)); ) {
+		if (1 != sscanf(line, "queued %ld", &id)
+			|| bsearch(&id, done, n, sizeof *done, compareLong))
+			continue;
+		if (-1 == writeAll(fd, p, mf->mem + off - p))
+			result = -1;
+		if (*npending == cap) {
+			if (NULL == (offs = realloc(*pending, (cap = 2 * cap + 64) * sizeof *offs))) {
+				result = -1;
+				break;
+			}
+			*pending = offs;
+		}
+		(*pending)[(*npending)++] = p - mf->mem;
+	}
+	free(done);
+
+	if (fdatasync(fd) || close(fd) || -1 == result || -1 == rename(tmp, path))
+		return -1;
+	/* and the rename is as durable as the lines */
+	if (-1 != (dir = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC))) {
+		fsync(dir);
+		close(dir);
+	}
+	return 0;
+}
+
+/*
+	open the journal at path, the spool being the
+	current directory; last is set to the highest id
+	it ever saw, and the unfinished jobs from the
+	socket are replayed
+*/
+int journal_open(const char *path, long *last, journal_replay_t *replay) {
+	char line[3 * PATH_MAX], user[64], section[64];
+	char source[PATH_MAX], folder[PATH_MAX], name[NAME_MAX + 1];
+	struct mfile mf = { NULL, 0 };
+	size_t *pending = NULL, off;
+	int i, npending = 0, mapped;
+	long id;
+
+	mapped = 0 == mfile_open(&mf, path);
+	if (!mapped && ENOENT != errno)
+		return -1;
+	if (-1 == compact(path, &mf, last, &pending, &npending)) {
+		if (mapped)
+			mfile_close(&mf);
+		free(pending);
+		return -1;
+	}
+
+	journal.fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (-1 == journal.fd || pthread_create(&journal.writer, NULL, writer, NULL)) {
+		if (mapped)
+			mfile_close(&mf);
+		free(pending);
+		return -1;
+	}
+
+	for (i = 0; i < npending; ++i) {
+		off = pending[i];
+		if (!nextLine(&mf, &off, line, sizeof line) || 1 != sscanf(line, "queued %ld", &id))
+			continue;
+		if (6 == sscanf(line, "queued %ld %63s %63s %4095s %4095s %255s",
+			&id, user, section, source, folder, name) && 0 == strcmp(name, "-"))
+			replay(id, source, folder, user, section);
+		else
+			/* in the spool, or not to be made out */
+			journal_finished(id);
+	}
+	if (mapped)
+		mfile_close(&mf);
+	free(pending);
+	return 0;
+}
+
+void journal_queued(const struct job *j) {
+	append("queued %ld %s %s %s %s %s\n", j->id, j->user, j->section,
+		j->source ? j->source : "-", j->folder ? j->folder : "-", j->name ? j->name : "-");
+}
+
+void journal_started(long id) {
+	append("started %ld\n", id);
+}
+
+void journal_finished(long id) {
+	append("finished %ld\n", id);
+}
+
+/*
+	how far the journal is appended, for a commit
+*/
+unsigned long journal_mark(void) {
+	unsigned long mark;
+
+	pthread_mutex_lock(&journal.lock);
+	mark = journal.appended;
+	pthread_mutex_unlock(&journal.lock);
+	return mark;
+}
+
+/*
+	wait for all that was appended to be synced; -1 if
+	some of it past mark could not be
+*/
+int journal_commit(unsigned long mark) {
+	unsigned long upto;
+	int result;
+
+	pthread_mutex_lock(&journal.lock);
+	upto = journal.appended;
+	while (journal.written < upto && -1 != journal.fd)
+		pthread_cond_wait(&journal.synced, &journal.lock);
+	result = -1 == journal.fd || journal.failed > mark ? -1 : 0;
+	pthread_mutex_unlock(&journal.lock);
+	return result;
+}
+
+void journal_report(FILE *fp) {
+	double sorted[JOURNAL_SAMPLES];
+	long n;
+
+	pthread_mutex_lock(&journal.lock);
+	n = journal.syncs < JOURNAL_SAMPLES ? journal.syncs : JOURNAL_SAMPLES;
+	fprintf(fp, "journal: %lu records in %ld syncs, %.1f per sync, %ld failed", journal.written,
+		journal.syncs, journal.syncs ? (double)journal.written / journal.syncs : 0,
+		journal.failures);
+	if (n) {
+		memcpy(sorted, journal.sync_ms, n * sizeof *sorted);
+		qsort(sorted, n, sizeof *sorted, compareDouble);
+		fprintf(fp, ", sync p50 %.2fms p99 %.2fms", sorted[n / 2], sorted[n * 99 / 100]);
+	}
+	pthread_mutex_unlock(&journal.lock);
+	fprintf(fp, "\n");
+}
+
+/*
+	what is appended is written before it closes
+*/
+void journal_close(void) {
+	if (-1 == journal.fd)
+		return;
+	pthread_mutex_lock(&journal.lock);
+	journal.stopping = 1;
+	pthread_cond_signal(&journal.more);
+	pthread_mutex_unlock(&journal.lock);
+	pthread_join(journal.writer, NULL);
+	close(journal.fd);
+	journal.fd = -1;
+	free(journal.buf);
+}
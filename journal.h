@@ -0,0 +1,27 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdio.h>
+
+/* the journal of judged, in the spool */
+#define JOURNAL_FILE "journal"
+
+/* sync times kept for the percentiles */
+#define JOURNAL_SAMPLES 1024
+
+struct job;
+
+/* a job that was queued and never finished */
+typedef void journal_replay_t(long id, const char *source, const char *folder,
+	const char *user, const char *section);
+
+int journal_open(const char *path, long *last, journal_replay_t *replay);
+void journal_queued(const struct job *j);
+void journal_started(long id);
+void journal_finished(long id);
+unsigned long journal_mark(void);
+int journal_commit(unsigned long mark);
+void journal_report(FILE *fp);
+void journal_close(void);
+
+#endif
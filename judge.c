@@ -0,0 +1,811 @@
+/*
+	The judging core: a submission is run against the
+	test cases of a problem, each traced in a sandbox
+	and checked against its expected output. It is a
+	library for the judge command and the daemon, so
+	several submissions may be judged at the same time.
+*/
+
+#include "common.h"
+#include "mfile.h"
+#include "canon.h"
+#include "problem.h"
+#include "token.h"
+#include "tokcache.h"
+#include "unordered.h"
+#include "spj.h"
+#include "hint.h"
+#include "myers.h"
+#include "judge.h"
+#include "history.h"
+#include "admit.h"
+
+#define MSG_ERR_RET(msg, res) \
+	do { fprintf(stderr, "%s\n", msg); return(res); } while (0)
+
+#define MSG_ERR_END(msg, res) \
+	do { fprintf(stderr, "%s\n", msg); result = (res); goto END; } while (0)
+
+const char *verdict[] = {
+	[SYSTEM_ERROR] = "System Error",
+	[COMPILE_ERROR] = "Compile Error",
+	[RUNTIME_ERROR] = "Runtime Error",
+	[TIME_LIMIT_EXCEEDED] = "Time Limit Exceeded",
+	[MEMORY_LIMIT_EXCEEDED] = "Memory Limit Exceeded",
+	[OUTPUT_LIMIT_EXCEEDED] = "Output Limit Exceeded",
+	[PRESENTATION_ERROR] = "Presentation Error",
+	[WRONG_ANWSER] = "Wrong Anwser",
+	[ACCEPTED] = "Accepted",
+};
+
+/*
+	check whether the value in REG_SYS_CALL(x)
+	is amongst the allowed system call list
+*/
+int isAllowedCall(int syscall) {
+	int i;
+
+	for (i = 0; -1 != strace[i]; ++i)
+		if (syscall == strace[i])
+			return 1;
+	return 0;
+}
+
+/*
+	check whether the value in REG_ARG_1(x)
+	is amongst allowed library mapping list
+*/
+int isValidAccess(const char *file) {
+	int i;
+
+	for (i = 0; ltrace[i]; ++i)
+		if (0 == strcmp(file, ltrace[i]))
+			return 1;
+	return 0;
+}
+
+/*
+	a wrap-up function for setting up resource limit
+*/
+
+void setRlimit(const struct problem *pb) {
+	struct rlimit usr_limit;
+
+	usr_limit.rlim_cur = pb->time_limit < 1000 ? 1 : pb->time_limit / 1000;
+	usr_limit.rlim_max = usr_limit.rlim_cur + 1;	// second(s)
+	if (setrlimit(RLIMIT_CPU, &usr_limit))
+		EXIT_MSG("Set Time Limit Failed", SYSTEM_ERROR);
+
+	usr_limit.rlim_cur = pb->memory_limit;
+	usr_limit.rlim_max = pb->memory_limit;		// byte(s)
+	if (setrlimit(RLIMIT_AS, &usr_limit))
+		EXIT_MSG("Set Memory Limit Failed", SYSTEM_ERROR);
+}
+
+#define kill_it(pid) ptrace(PTRACE_KILL, pid, NULL, NULL);
+
+int invalidAccess(pid_t pid, struct user_regs_struct *registers) {
+	int i;
+	long access_file[10];
+
+	/* peek which file the process is about to open */
+	for (i = 0; i < 10; i++) {
+		access_file[i] = ptrace(PTRACE_PEEKDATA,
+			pid, REG_ARG_1(registers) + i * sizeof(long), NULL);
+		if (0 == access_file[i])
+			break;
+	}
+	if (!isValidAccess((const char*)access_file)) {
+		kill_it(pid);
+		fprintf(stderr, "%s\t", (const char*)access_file);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+	peak resident size of the candidate in KB, from its
+	own address space: rusage would also count the one
+	of the judge it was forked from, before the exec
+*/
+long peakMemory(pid_t pid) {
+	char path[64], line[128];
+	long peak = 0;
+	FILE *fp;
+
+	snprintf(path, sizeof path, "/proc/%d/status", (int)pid);
+	if (NULL == (fp = fopen(path, "r")))
+		return 0;
+	while (fgets(line, sizeof line, fp))
+		if (1 == sscanf(line, "VmHWM: %ld", &peak))
+			break;
+	fclose(fp);
+	return peak;
+}
+
+/*
+	Given the input file and output file, respectively,
+	decide whether a specified source is satiesfied.
+	The child is left in tc for a cancel to kill, and
+	it is always reaped before returning.
+*/
+int run(const char *bin, const char *in, const char *out, struct testcase *tc) {
+	int result = EXIT_SUCCESS;
+	int status, done = 0;
+	long peak = 0;
+	
+	struct rusage usage;
+	struct user_regs_struct regs;
+	
+	pid_t child = vfork();
+
+	/* assure that parent gets executed after child exits */
+	if (child < 0) {
+		MSG_ERR_RET("vfork() Failed", SYSTEM_ERROR);
+	}
+	/* fork a child to monitor(ptrace) its status */
+	if (0 == child) {
+		int fd[2];
+
+		setRlimit(tc->suite->pb);
+
+		/* dup2 guarantees the atomic operation */
+		
+		if ((fd[0] = open(in, O_RDONLY, 0644)) < 0 || dup2(fd[0], STDIN_FILENO) < 0)
+			EXIT_MSG("dup2(STDIN_FILENO) Failed", SYSTEM_ERROR);
+
+		if ((fd[1] = creat(out, 0644)) < 0 || dup2(fd[1], STDOUT_FILENO) < 0)
+			EXIT_MSG("dup2(STDOUT_FILENO) Failed", SYSTEM_ERROR);
+
+		if (ptrace(PTRACE_TRACEME, 0, NULL, NULL))
+			EXIT_MSG("PTRACE_TRACEME Failed", SYSTEM_ERROR);
+
+		if (-1 == execl(bin, "", NULL))
+			EXIT_MSG("execl() Failed", SYSTEM_ERROR);
+	}
+
+	/* an earlier test may have failed meanwhile */
+	pthread_mutex_lock(&tc->suite->lock);
+	tc->child = child;
+	if (tc->cancelled)
+		kill(child, SIGKILL);
+	pthread_mutex_unlock(&tc->suite->lock);
+
+	for ( ; ; ) {
+		if (-1 == wait4(child, &status, WSTOPPED, &usage))
+			MSG_ERR_END("wait4() Failed", SYSTEM_ERROR);
+
+		/* child has already exited */
+		if (WIFEXITED(status)) {
+			done = 1;
+			if (SYSTEM_ERROR == WEXITSTATUS(status))
+				result = SYSTEM_ERROR;
+			goto END;
+		} else if (WIFSIGNALED(status)) {
+			/* SIGKILL, by the hard limit or a cancel */
+			done = 1;
+			if (EXIT_SUCCESS == result)
+				result = TIME_LIMIT_EXCEEDED;
+			goto END;
+		} else if (SIGTRAP != WSTOPSIG(status)) {
+			kill_it(child);
+			switch (WSTOPSIG(status)) {
+				case SIGSEGV:
+				if (peakMemory(child) * (sysconf(_SC_PAGESIZE)) / tc->suite->pb->memory_limit < 2)
+					result = MEMORY_LIMIT_EXCEEDED;
+				else
+					result = RUNTIME_ERROR;
+				break;
+				case SIGALRM: case SIGXCPU: case SIGKILL:
+					result = TIME_LIMIT_EXCEEDED;
+				break;
+			}
+		}
+
+		/* unable to peek register info */
+		if (-1 == ptrace(PTRACE_GETREGS, child, NULL, &regs))
+			goto END;
+
+		if (!isAllowedCall(REG_SYS_CALL(&regs))) {
+			kill_it(child);
+			fprintf(stderr, "%llu\t", REG_SYS_CALL(&regs));
+			MSG_ERR_END("Invalid Syscall", RUNTIME_ERROR);
+		}
+
+		/* about to leave, its memory is still there */
+		if (SYS_exit_group == REG_SYS_CALL(&regs))
+			peak = peakMemory(child);
+
+		/* watch what the child is going to open */
+		if (SYS_open == REG_SYS_CALL(&regs)) {
+			if (invalidAccess(child, &regs))
+				MSG_ERR_END("Invalid Access", RUNTIME_ERROR);
+		}
+
+		/* trace next system call */
+		if (-1 == ptrace(PTRACE_SYSCALL, child, NULL, NULL))
+			MSG_ERR_END("PTRACE_SYSCALL Failed", SYSTEM_ERROR);
+	}
+END:
+	/* leave no zombie behind, its usage is final then */
+	while (!done) {
+		kill(child, SIGKILL);
+		if (-1 == wait4(child, &status, 0, &usage))
+			break;
+		done = WIFEXITED(status) || WIFSIGNALED(status);
+	}
+	pthread_mutex_lock(&tc->suite->lock);
+	tc->child = -1;
+	pthread_mutex_unlock(&tc->suite->lock);
+
+	tc->time = usage.ru_utime.tv_sec * 1000 + usage.ru_utime.tv_usec / 1000
+		+ usage.ru_stime.tv_sec * 1000 + usage.ru_stime.tv_usec / 1000;
+	tc->memory = peak ? peak : usage.ru_maxrss * (sysconf(_SC_PAGESIZE) / 1024);
+
+	/* the CPU limit is only kept to the second */
+	if (EXIT_SUCCESS == result && tc->time > tc->suite->pb->time_limit)
+		result = TIME_LIMIT_EXCEEDED;
+	return result;
+}
+
+/*
+	test whether two outputs differ only in white space
+*/
+int squeeze(const char *s1, size_t n1, const char *s2, size_t n2) {
+	const char *e1 = s1 + n1, *e2 = s2 + n2;
+
+	for ( ; ; ) {
+		/* skip invisible characters */
+		while (s1 < e1 && isspace((unsigned char)*s1))
+			s1++;
+		while (s2 < e2 && isspace((unsigned char)*s2))
+			s2++;
+		/* either is exhausted, no need to compare more */
+		if (!(s1 < e1 && s2 < e2))
+			break;
+		/* neither is exhausted */
+		if (*s1 != *s2)
+			return 0;
+		/* keep running */
+		++s1;
+		++s2;
+	}
+	return !(s1 < e1 || s2 < e2);
+}
+
+/*
+	whether the output is the reference as written, not
+	only as canonicalized; the original is read only for
+	a reference that has quirks, -1 if it cannot be
+*/
+static int verbatim(const struct canon *ref, const char *out, const char *s, size_t len) {
+	struct mfile mf;
+	int same;
+
+	if (!ref->flags)
+		return len == ref->len && 0 == memcmp(ref->text, s, len);
+	if (-1 == mfile_open(&mf, out))
+		return -1;
+	same = len == mf.len && 0 == memcmp(mf.mem, s, len);
+	mfile_close(&mf);
+	return same;
+}
+
+/*
+	accepted if the output is one of the references out
+	and its alternatives as written, else presentation
+	error if it differs from one only in white space,
+	CRLF and trailing blanks included; which is set to
+	the reference that matched, or that came closest,
+	and m to where the output departs from that one
+*/
+int diff(const struct canon *ref, int n, const char *out, const char *s, size_t len,
+	int *which, struct mismatch *m) {
+	char path[PATH_MAX];
+	int i, same;
+
+	/* test if the same, once canonical and then byte for byte */
+	if (canon_match_any(ref, n, s, len, which, m) >= 0) {
+		for (i = 0; i < n; ++i) {
+			canon_alt_path(path, sizeof path, out, i);
+			if (-1 == (same = verbatim(&ref[i], path, s, len)))
+				MSG_ERR_RET("mfile_open(out) Failed", SYSTEM_ERROR);
+			if (same) {
+				*which = i;
+				return ACCEPTED;
+			}
+		}
+		return PRESENTATION_ERROR;
+	}
+
+	for (i = 0; i < n; ++i)
+		if (squeeze(ref[i].text, ref[i].len, s, len)) {
+			*which = i;
+			return PRESENTATION_ERROR;
+		}
+	return WRONG_ANWSER;
+}
+
+/*
+	when the tested source file has been compiled and
+	successfully produced the output file, this function
+	will perform the answer checking exercise; ref is
+	set to the alternative of out that matched best.
+	For a wrong answer, it shows on log where it went
+	wrong.
+*/
+int check(const struct problem *pb, const char *in, const char *out,
+	const char *tmp, int *ref, FILE *log) {
+	int i, n = 1, result;
+	struct canon expect[CANON_MAX_REFS];
+	struct mfile user, input;
+	struct mismatch where;
+	struct stat st;
+	struct unordered_diff missing;
+	char message[SPJ_MESSAGE_LEN];
+
+	*ref = 0;
+	memset(&where, 0, sizeof where);
+
+	/* the special judge works on the raw files */
+	if (pb->spj) {
+		if (-1 == stat(tmp, &st))
+			MSG_ERR_RET("stat(tmp) Failed", SYSTEM_ERROR);
+		if (MAX_OUTPUT <= st.st_size)
+			return OUTPUT_LIMIT_EXCEEDED;
+
+		result = spj_check(pb->spj, in, out, tmp, message);
+		if (ACCEPTED != result && *message)
+			fprintf(log, "Checker:^%s$\n", message);
+		return result;
+	}
+
+	/* the expected outputs, canonicalized at ingest */
+	if (COMPARE_EXACT == pb->compare)
+		n = canon_load_refs(expect, out);
+	else if (-1 == canon_load(&expect[0], out))
+		n = -1;
+	if (-1 == n)
+		MSG_ERR_RET("canon_load(out) Failed", SYSTEM_ERROR);
+
+	/* map the candidate output to memory for efficiency */
+	if (-1 == mfile_open(&user, tmp)) {
+		for (i = 0; i < n; ++i)
+			canon_free(&expect[i]);
+		MSG_ERR_RET("mfile_open(tmp) Failed", SYSTEM_ERROR);
+	}
+
+	if (MAX_OUTPUT <= user.len)
+		result = OUTPUT_LIMIT_EXCEEDED;
+	else if (COMPARE_FLOAT == pb->compare) {
+		/* tokenized once, then resident for later submissions */
+		const struct tokens *tokens = tokcache_get(expect->hash, expect->text, expect->len);
+
+		if (tokens) {
+			result = token_match(pb, tokens, user.mem, user.len, &where);
+			tokcache_put(tokens);
+		} else
+			result = token_compare(pb, expect->text, expect->len,
+				user.mem, user.len, &where);
+	} else if (COMPARE_UNORDERED == pb->compare) {
+		result = unordered_compare(expect->text, expect->len, user.mem, user.len, &missing);
+		if (missing.line)
+			fprintf(log, "%s:^%.*s$\n", missing.missing ? "Missing" : "Extra",
+				(int)missing.len, missing.line);
+	}
+	else
+		result = diff(expect, n, out, user.mem, user.len, ref, &where);
+
+	/* located during the comparison, shown from the mappings */
+	if (WRONG_ANWSER == result && COMPARE_UNORDERED != pb->compare
+		&& 0 == mfile_open(&input, in)) {
+		hint_print(log, input.mem, input.len, expect[*ref].text,
+			expect[*ref].len, user.mem, user.len, &where);
+		mfile_close(&input);
+
+		/* how far it goes astray, if the problem asks for it */
+		if (pb->diff_report)
+			myers_report(log, expect[*ref].text, expect[*ref].len, where.exp,
+				user.mem, user.len, where.usr, pb->diff_report);
+	}
+
+	/* clean */
+	for (i = 0; i < n; ++i)
+		canon_free(&expect[i]);
+	if (-1 == mfile_close(&user))
+		MSG_ERR_RET("munmap() Failed", SYSTEM_ERROR);
+	return result;
+}
+
+/*
+	test if haystack ends with the needle
+*/
+int endWith(const char *haystack, const char *needle) {
+	size_t haystackLen = strlen(haystack);
+	size_t needleLen = strlen(needle);
+
+	if (haystackLen < needleLen)
+		return 0;
+
+	char *end = (char *)haystack + (haystackLen - needleLen);
+	return 0 == strcmp(end, needle);
+}
+
+/*
+	count how many .in files there are in the folder
+*/
+int countFiles(const char *directory, const char *suffix) {
+	int n, cnt = 0;
+	struct dirent **filename;
+
+	n = scandir(directory, &filename, NULL, alphasort);
+	if (n < 0)
+		MSG_ERR_RET("scandir() Failed", -1);
+	else
+		while (n--) {
+			if (endWith(filename[n]->d_name, suffix))
+				++cnt;
+			free(filename[n]);
+		}
+	free(filename);
+	return cnt;
+}
+#define countTestdata(dir) countFiles(dir, ".in")
+
+/*
+	check the output of a test case that ran through;
+	the output file is removed then, only the verdict
+	is kept
+*/
+void checkTest(const struct suite *s, struct testcase *tc) {
+	FILE *log;
+
+	if (EXIT_SUCCESS == tc->result) {
+		if (NULL == (log = open_memstream(&tc->log, &tc->log_len)))
+			tc->result = SYSTEM_ERROR;
+		else {
+			tc->result = check(s->pb, tc->in, tc->out, tc->tmp, &tc->ref, log);
+			fclose(log);
+		}
+	}
+	if (-1 == unlink(tc->tmp) && ENOENT != errno)
+		fprintf(stderr, "unlink Failed\n");
+}
+
+/*
+	whether a test need not run, s->lock held: it is
+	after the lowest failure so far or, with subtasks,
+	every group it is in has failed already
+*/
+static int skipped(const struct suite *s, int num) {
+	int g, grouped = 0;
+
+	if (!s->pb->ngroups)
+		return num > s->failed;
+	for (g = 0; g < s->pb->ngroups; ++g)
+		if (problem_in_group(s->pb, g, num)) {
+			if (!s->dead[g])
+				return 0;
+			grouped = 1;
+		}
+	return grouped;
+}
+
+/*
+	the verdict of a test is in; the verdict of all is
+	that of the lowest failing test, and its groups are
+	lost, so tests started and still running are
+	cancelled if this one failed and they need not run
+*/
+void settleTest(struct suite *s, struct testcase *tc) {
+	int i, g, counts;
+	struct testcase *later;
+
+	pthread_mutex_lock(&s->lock);
+	/* a test after the first failure does not count */
+	counts = !tc->cancelled && (s->pb->ngroups || tc->num < s->failed);
+	if (ACCEPTED != tc->result && counts) {
+		if (tc->num < s->failed)
+			s->failed = tc->num;
+		for (g = 0; g < s->pb->ngroups; ++g)
+			if (problem_in_group(s->pb, g, tc->num))
+				s->dead[g] = 1;
+		for (i = 0; i < s->next; ++i) {
+			later = &s->tc[s->order[i]];
+			if (later == tc || !skipped(s, later->num) || -1 == later->child)
+				continue;
+			later->cancelled = 1;
+			if (later->child > 0)
+				kill(later->child, SIGKILL);
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	if (counts && s->progress)
+		s->progress(tc, s->arg);
+}
+
+/*
+	a worker takes test cases in the order given,
+	passing over those that need not run, so groups
+	of tests still alive run side by side;
+	the output is checked here, or handed off to be
+	checked elsewhere while the next test runs
+*/
+void *judgeTests(void *arg) {
+	struct suite *s = arg;
+	struct testcase *tc;
+
+	for ( ; ; ) {
+		pthread_mutex_lock(&s->lock);
+		while (s->next < s->ordered && skipped(s, s->order[s->next]))
+			s->next++;
+		if (s->next >= s->ordered) {
+			pthread_mutex_unlock(&s->lock);
+			return NULL;
+		}
+		tc = &s->tc[s->order[s->next++]];
+		pthread_mutex_unlock(&s->lock);
+
+		/* room for the run to reach its limit, or wait */
+		tc->waited = admit_enter(s->pb->memory_limit);
+		tc->result = run(s->bin, tc->in, tc->tmp, tc);
+		admit_leave(s->pb->memory_limit);
+		if (EXIT_SUCCESS == tc->result && s->handoff) {
+			pthread_mutex_lock(&s->lock);
+			s->pending++;
+			pthread_mutex_unlock(&s->lock);
+			s->handoff(tc, s->arg);
+			continue;
+		}
+		checkTest(s, tc);
+		settleTest(s, tc);
+	}
+}
+
+/*
+	check a test case handed off by suite_run
+*/
+void suite_check(struct testcase *tc) {
+	struct suite *s = tc->suite;
+
+	checkTest(s, tc);
+	settleTest(s, tc);
+
+	pthread_mutex_lock(&s->lock);
+	if (0 == --s->pending)
+		pthread_cond_broadcast(&s->checked);
+	pthread_mutex_unlock(&s->lock);
+}
+
+/*
+	prepare the test cases of folder, with a fresh
+	workspace under the current directory
+*/
+int suite_open(struct suite *s, const char *folder, const struct problem *pb) {
+	int num;
+	struct testcase *tc;
+
+	memset(s, 0, sizeof *s);
+	s->pb = pb;
+	if (sizeof s->folder <= snprintf(s->folder, sizeof s->folder, "%s", folder))
+		MSG_ERR_RET("Path Too Long", -1);
+	if (-1 == (s->total = countTestdata(folder)))
+		return -1;
+	s->failed = s->total;
+
+	strcpy(s->dir, "judge.XXXXXX");
+	if (NULL == mkdtemp(s->dir))
+		MSG_ERR_RET("mkdtemp() Failed", -1);
+	if (NULL == (s->tc = calloc(s->total + 1, sizeof *s->tc))
+		|| NULL == (s->order = calloc(s->total + 1, sizeof *s->order))
+		|| NULL == (s->dead = calloc(pb->ngroups + 1, sizeof *s->dead))) {
+		free(s->tc);
+		free(s->order);
+		rmdir(s->dir);
+		MSG_ERR_RET("calloc() Failed", -1);
+	}
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->checked, NULL);
+
+	for (num = 0; num < s->total; ++num) {
+		tc = &s->tc[num];
+		tc->suite = s;
+		tc->num = num;
+		if (sizeof tc->in <= snprintf(tc->in, sizeof tc->in, "%s/%d.in", folder, num)
+			|| sizeof tc->out <= snprintf(tc->out, sizeof tc->out, "%s/%d.out", folder, num)
+			|| sizeof tc->tmp <= snprintf(tc->tmp, sizeof tc->tmp, "%s/%d.out", s->dir, num)) {
+			suite_close(s);
+			MSG_ERR_RET("Path Too Long", -1);
+		}
+	}
+	return 0;
+}
+
+/*
+	a verdict known without running the test, as if it
+	had just been judged
+*/
+void suite_known(struct suite *s, int num, int result, long time, long memory) {
+	struct testcase *tc = &s->tc[num];
+
+	tc->result = result;
+	tc->time = time;
+	tc->memory = memory;
+	tc->cached = 1;
+	settleTest(s, tc);
+}
+
+/*
+	run the tests in order with up to jobs at once, the
+	calling thread being one of the workers; returns
+	when every output has been checked
+*/
+static int runOrder(struct suite *s, const char *bin, int jobs) {
+	int num;
+
+	s->bin = bin;
+	s->next = 0;
+	/* never more workers than tests, whatever -j said */
+	if (jobs > s->ordered || jobs < 1)
+		jobs = s->ordered ? s->ordered : 1;
+
+	pthread_t worker[jobs];
+
+	for (num = 1; num < jobs; ++num)
+		if (pthread_create(&worker[num], NULL, judgeTests, s))
+			break;
+	judgeTests(s);
+	while (--num > 0)
+		pthread_join(worker[num], NULL);
+
+	/* the outputs handed off are all checked */
+	pthread_mutex_lock(&s->lock);
+	while (s->pending)
+		pthread_cond_wait(&s->checked, &s->lock);
+	pthread_mutex_unlock(&s->lock);
+
+	return s->failed < s->total ? s->tc[s->failed].result : ACCEPTED;
+}
+
+/*
+	judge bin on the sample tests of the problem only;
+	the verdict is of the samples, to be told early
+*/
+int suite_samples(struct suite *s, const char *bin, int jobs) {
+	int i, j, num;
+
+	s->ordered = 0;
+	for (i = 0; i < s->pb->nsamples; ++i) {
+		if ((num = s->pb->samples[i]) >= s->total || s->tc[num].result)
+			continue;
+		for (j = 0; j < s->ordered && num != s->order[j]; ++j)
+			;
+		if (j == s->ordered)
+			s->order[s->ordered++] = num;
+	}
+	return runOrder(s, bin, jobs);
+}
+
+/*
+	judge bin on the tests not judged yet, in the order
+	their history suggests; the verdict is still that
+	of the lowest failing test of all
+*/
+int suite_run(struct suite *s, const char *bin, int jobs) {
+	int i, result;
+
+	history_order(s->folder, s->total, jobs, s->order);
+	for (i = s->ordered = 0; i < s->total; ++i)
+		if (!s->tc[s->order[i]].result)
+			s->order[s->ordered++] = s->order[i];
+	result = runOrder(s, bin, jobs);
+	history_record(s->folder, s);
+	return result;
+}
+
+/*
+	with subtasks, the points earned, and those there
+	are in total; -1 without
+*/
+int suite_score(const struct suite *s, int *total) {
+	int g, points = 0;
+
+	if (!s->pb->ngroups)
+		return -1;
+	for (g = *total = 0; g < s->pb->ngroups; ++g) {
+		*total += s->pb->groups[g].points;
+		if (!s->dead[g])
+			points += s->pb->groups[g].points;
+	}
+	return points;
+}
+
+/*
+	the points of each group and their sum follow the
+	verdict
+*/
+static void score(const struct suite *s, FILE *out) {
+	int g, points, total;
+
+	if (-1 == (points = suite_score(s, &total)))
+		return;
+	fprintf(out, " SCORE: %d/%d (", points, total);
+	for (g = 0; g < s->pb->ngroups; ++g)
+		fprintf(out, "%s%d", g ? " " : "", s->dead[g] ? 0 : s->pb->groups[g].points);
+	fprintf(out, ")");
+}
+
+/*
+	the verdict line goes to out, and to log what the
+	references matched and why the failing test failed;
+	time and memory are of the most demanding test
+*/
+void suite_report(const struct suite *s, FILE *out, FILE *log) {
+	int num, cached = 0;
+	long time = 0, memory = 0, waited = 0;
+	char path[PATH_MAX];
+	const struct testcase *tc;
+
+	for (num = 0; num < s->total; ++num) {
+		waited += s->tc[num].waited;
+		cached += s->tc[num].cached;
+	}
+	if (waited)
+		fprintf(log, "Waited %ldMS for memory\n", waited);
+	if (cached)
+		fprintf(log, "Reused %d of %d tests\n", cached, s->total);
+
+	for (num = 0; num < s->failed; ++num) {
+		tc = &s->tc[num];
+		if (tc->ref) {
+			canon_alt_path(path, sizeof path, tc->out, tc->ref);
+			fprintf(log, "Matched:^%s$\n", path);
+		}
+		if (tc->time > time)
+			time = tc->time;
+		if (tc->memory > memory)
+			memory = tc->memory;
+	}
+
+	if (s->failed < s->total) {
+		tc = &s->tc[s->failed];
+		if (tc->log_len)
+			fwrite(tc->log, 1, tc->log_len, log);
+		fprintf(out, "%s", verdict[tc->result]);
+	} else
+		fprintf(out, "Accepted TIME: %ldMS MEM: %ldKB", time, memory);
+	score(s, out);
+	fprintf(out, "\n");
+}
+
+/*
+	remove the workspace with whatever is left in it
+*/
+void suite_close(struct suite *s) {
+	int n;
+	struct dirent **entry;
+	char path[PATH_MAX];
+
+	if (s->tc) {
+		for (n = 0; n < s->total; ++n)
+			free(s->tc[n].log);
+		free(s->tc);
+		free(s->order);
+		free(s->dead);
+		s->tc = NULL;
+		pthread_cond_destroy(&s->checked);
+		pthread_mutex_destroy(&s->lock);
+	}
+
+	if ((n = scandir(s->dir, &entry, NULL, NULL)) >= 0) {
+		while (n--) {
+			if (snprintf(path, sizeof path, "%s/%s", s->dir, entry[n]->d_name) < sizeof path)
+				unlink(path);
+			free(entry[n]);
+		}
+		free(entry);
+	}
+	if (-1 == rmdir(s->dir))
+		fprintf(stderr, "rmdir Failed\n");
+}
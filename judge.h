@@ -0,0 +1,85 @@
+#ifndef JUDGE_H
+#define JUDGE_H
+
+#include <sys/types.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdio.h>
+
+struct problem;
+struct suite;
+
+/* what a verdict reads like */
+extern const char *verdict[];
+
+/* one test case, with its own output file */
+struct testcase {
+	struct suite *suite;
+	int num;
+	char in[PATH_MAX], out[PATH_MAX], tmp[PATH_MAX];
+	int result, ref;
+	long time, memory;
+
+	/* ms spent waiting for memory to run in */
+	long waited;
+
+	/* what the test is made of, and whether its verdict
+	   was known from an earlier judgement */
+	uint64_t digest;
+	int cached;
+
+	/* hints, shown only if this is the test reported */
+	char *log;
+	size_t log_len;
+
+	/* the candidate while it runs, -1 once it is over,
+	   and whether to stop it */
+	pid_t child;
+	int cancelled;
+};
+
+/* a submission against the test cases of a problem */
+struct suite {
+	const char *bin;
+	const struct problem *pb;
+	char folder[PATH_MAX];
+	struct testcase *tc;
+	int total;
+
+	/* the tests in the order to run them, next of which
+	   is the next to run */
+	int *order, ordered, next;
+
+	/* lowest failing test, total if none */
+	int failed;
+
+	/* for each subtask group, whether it is lost */
+	int *dead;
+
+	/* the workspace holding the outputs */
+	char dir[PATH_MAX];
+
+	/* told of each test that counts, as it is judged */
+	void (*progress)(const struct testcase *tc, void *arg);
+	void *arg;
+
+	/* if set, given the outputs to check by suite_check */
+	void (*handoff)(struct testcase *tc, void *arg);
+	int pending;
+	pthread_cond_t checked;
+
+	/* guards the above and the children of the tests */
+	pthread_mutex_t lock;
+};
+
+int suite_open(struct suite *s, const char *folder, const struct problem *pb);
+void suite_known(struct suite *s, int num, int result, long time, long memory);
+int suite_samples(struct suite *s, const char *bin, int jobs);
+int suite_run(struct suite *s, const char *bin, int jobs);
+void suite_check(struct testcase *tc);
+int suite_score(const struct suite *s, int *total);
+void suite_report(const struct suite *s, FILE *out, FILE *log);
+void suite_close(struct suite *s);
+
+#endif
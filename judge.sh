@@ -21,20 +21,21 @@ name=${name%%.*}
 # determine which compiler to exercise
 suffix=${source##*.}
 
-# try compiling the source file
+# try compiling the source file, which is not compiled
+# again if it was before, see build.c; COMPILE_CACHE is
+# where compiled binaries and diagnostics are kept
 case $suffix in
-	c) clang -o $name -Wall -lm -std=c11 $source
-	if [ 0 -ne $? ]; then
-		status="Compile Error"
-		echo $name , $status
-		exit 0
-	fi
-	;;
-
-	cpp) clang++ -o $name -Wall -std=c++11 $source
-	if [ 0 -ne $? ]; then
-		status="Compile Error"
+	c|cpp) $folder/build -C ${COMPILE_CACHE:-$folder/compiled} $source $name
+	built=$?
+	if [ 0 -ne $built ]; then
+		# only 2 is the source's fault, see common.h
+		if [ 2 -eq $built ]; then
+			status="Compile Error"
+		else
+			status="System Error"
+		fi
 		echo $name , $status
+		$folder/results $problem add $name $status
 		exit 0
 	fi
 	;;
@@ -42,10 +43,17 @@ esac
 
 #echo $folder/judge $name $problem
 # compiled successfully, execute it and compare the output
-status=`$folder/judge $name $problem`
+# JOBS test cases may run at once, one by one if unset,
+# within MEMORY megabytes if set, half the host's if not;
+# tests judged before are kept in records, and not run
+# again unless the binary, the test or its limits change;
+# the verdict is kept among the results of the problem,
+# see "results" to query them
+mkdir -p $problem/records
+status=`$folder/judge -j ${JOBS:-1} ${MEMORY:+-M $MEMORY} -r $problem/records/$name -s $name $name $problem`
 
 # remove the binary executeable file
 rm $name
 
-# print the result and append it to destination
-echo $name , $status | tee -a $problem/result
+# print the result
+echo $name , $status
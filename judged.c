@@ -0,0 +1,1253 @@
+/*
+	judged keeps the judge resident: submissions are
+	dropped into a spool directory and judged by a pool
+	of workers, while problems, checkers and tokenized
+	outputs stay loaded from one submission to the next.
+
+	spool/tmp	a job is written here first,
+	spool/new	then renamed here to submit it;
+	spool/cur	where a worker claims it,
+	spool/done	and where its verdict turns up.
+
+	A job is one line, "source_file problem_folder", as
+	the arguments of judge.sh, then maybe the user and
+	the section submitting it; relative paths are taken
+	from the spool. The verdict file holds the line that
+	judge.sh prints, followed by the diagnostics.
+
+	Jobs may come by spool/judged.sock as well, see
+	api.c; those are not written to done.
+
+	A job goes through the stages of a pipeline, each
+	with a pool of workers sized on its own: compile,
+	sample, run, compare and report. So a submission
+	compiles while the one before it runs, and the
+	output of a test is compared while the next test
+	runs. Every run holds its memory limit out of a
+	budget for the host while it lasts, see admit.c.
+
+	The sample tests of a problem are judged apart,
+	ahead of every full run, so that a preliminary
+	verdict comes out quickly.
+
+	Jobs wait to compile and to run in the order of a
+	weighted fair share among users and sections, see
+	fair.c; their weights are read from spool/weights
+	at start.
+
+	A job the same as one judged before, or being
+	judged, is told the same verdict without running,
+	unless its problem says "cache = no"; see vcache.c.
+	What compiled before, for this job or another, is
+	taken from spool/compiled rather than compiled
+	again, see compile.c.
+
+	Every job is written to spool/journal as it is
+	queued, started and finished, see journal.c; jobs
+	from the socket that a crash cut short are queued
+	again when judged starts, or once there is room.
+
+	A problem is judged from a copy of its folder in
+	the spool, problem.XXXXXX, loaded once along with
+	its checker. When the folder changes and then stays
+	unchanged for JUDGED_SETTLE ms, a new copy is loaded
+	aside and new jobs go to it; jobs already under way
+	finish on the old one, removed after the last of them.
+
+	With -p, judged waits for workers on that TCP port,
+	of the loopback unless a host is given as well, and
+	the runs go to them, see remote.c; a run no worker
+	takes is run here. Workers must hold the key in the
+	file given by -k.
+*/
+
+#include "common.h"
+#include "problem.h"
+#include "spj.h"
+#include "judge.h"
+#include "judged.h"
+#include "stage.h"
+#include "admit.h"
+#include "fair.h"
+#include "compile.h"
+#include "vcache.h"
+#include "remote.h"
+#include "journal.h"
+#include "resultlog.h"
+#include "hash.h"
+#include "history.h"
+
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <signal.h>
+#include <stdarg.h>
+
+#define USAGE "Usage: judged [-c compilers] [-s samplers] [-w runners] [-m comparers]\
+ [-j jobs] [-M memory_mb] [-p [host:]port -k key_file] spool_dir"
+
+/* jobs waiting to compile, the rest stay in new */
+#define JUDGED_QUEUE 8192
+
+/* room between the later stages */
+#define JUDGED_BACKLOG 32
+
+/* latencies kept for the percentiles */
+#define JUDGED_SAMPLES 4096
+
+/* ms a problem folder is to stay unchanged before reloading it */
+#define JUDGED_SETTLE 250
+
+/* the compile cache, in the spool */
+#define JUDGED_COMPILED "compiled"
+
+/* a job on its way through the stages */
+struct task {
+	struct job *job;
+	struct suite suite;
+	int opened, result, told;
+	double tag;
+
+	/* the generation of its problem */
+	struct warm *w;
+
+	/* its source and binary to the verdict cache */
+	uint64_t key, bin_key;
+	int leads, cached;
+
+	/* the hash of its binary, for the results */
+	uint64_t binary;
+	char bin[PATH_MAX], diag[PATH_MAX], claimed[PATH_MAX];
+
+	/* run on a worker, whose tests are not in the suite */
+	int remote;
+
+	/* the verdict line, and what else is to be said */
+	FILE *out, *err;
+	char *status, *log;
+	size_t status_len, log_len;
+
+	/* waiting to compile again, see retry() */
+	struct task *next;
+};
+
+/*
+	a generation of a problem: its folder copied aside
+	and loaded once, with its checker
+*/
+struct warm {
+	char dir[PATH_MAX], data[PATH_MAX];
+	struct problem pb;
+	struct spj spj;
+	uint64_t version;
+
+	/* tasks judged by it, and one while it is current */
+	int refs;
+
+	/* the watch on dir, the changes seen since it was
+	   copied, when the last one was, and how many a
+	   reload in progress saw */
+	int wd;
+	long changes, seen;
+	struct timespec changed;
+	int loading;
+
+	struct warm *next;
+};
+
+/* a job of the journal that did not fit in the queue */
+struct replay {
+	long id;
+	char source[PATH_MAX], folder[PATH_MAX], user[64], section[64];
+	struct replay *next;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	int overflow;
+
+	/* jobs to queue again once there is room, in order */
+	struct replay *replays, **replayed;
+
+	/* followers of a failed job, to compile again */
+	struct task *retries, **retried;
+
+	struct job jobs[JUDGED_JOBS];
+	long last;
+
+	/* tells the main thread that jobs have news */
+	int wake;
+
+	/* the current generation of each problem, those
+	   still in use, and how many were reloaded */
+	struct warm *problems;
+	int generations;
+	long reloads;
+	int notify;
+
+	/* what it takes from submission to verdict, in ms */
+	double latency[JUDGED_SAMPLES];
+	long served;
+
+	/* and to the first word on it, maybe the verdict */
+	double feedback[JUDGED_SAMPLES];
+	long told;
+	struct timespec start;
+} spool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static struct stage compiler, sampler, runner, comparer, reporter, loader;
+
+static int jobs = 1, remote;
+static volatile sig_atomic_t stopping, reporting;
+
+static void onSignal(int sig) {
+	if (SIGUSR1 == sig)
+		reporting = 1;
+	else
+		stopping = 1;
+}
+
+static double since(const struct timespec *t) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (now.tv_sec - t->tv_sec) * 1e3 + (now.tv_nsec - t->tv_nsec) / 1e6;
+}
+
+/*
+	a line for the watchers of the job, spool.lock held;
+	the last one marks it done at the same time
+*/
+static void record(struct job *j, int last, const char *text) {
+	char line[256], *more;
+	int n;
+
+	n = snprintf(line, sizeof line, "%ld %s", j->id, text);
+	if (n >= sizeof line)
+		n = sizeof line - 1;
+
+	if (j->len + n > j->cap) {
+		if (NULL == (more = realloc(j->events, 2 * j->cap + n)))
+			n = 0;
+		else {
+			j->events = more;
+			j->cap = 2 * j->cap + n;
+		}
+	}
+	memcpy(j->events + j->len, line, n);
+	j->len += n;
+	j->done = last;
+}
+
+static void emit(struct job *j, int last, const char *fmt, ...) {
+	char text[256];
+	uint64_t one = 1;
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(text, sizeof text, fmt, ap);
+	va_end(ap);
+
+	pthread_mutex_lock(&spool.lock);
+	record(j, last, text);
+	pthread_mutex_unlock(&spool.lock);
+
+	if (8 != write(spool.wake, &one, 8))
+		fprintf(stderr, "eventfd Failed\n");
+}
+
+/*
+	queue a job; -1 if the workers are too far behind,
+	then a job of the spool waits in new for a scan
+*/
+long job_new(const char *name, const char *source, const char *folder,
+	const char *user, const char *section) {
+	struct job *j;
+	struct task *t;
+	double tag;
+
+	user = user ? user : JUDGED_USER;
+	section = section ? section : JUDGED_SECTION;
+	tag = fair_tag(user, section, folder);
+
+	pthread_mutex_lock(&spool.lock);
+	j = &spool.jobs[(spool.last + 1) % JUDGED_JOBS];
+	if ((j->id && !j->done) || NULL == (t = calloc(1, sizeof *t)))
+		goto BUSY;
+	free(j->name);
+	free(j->source);
+	free(j->folder);
+	free(j->user);
+	free(j->section);
+	free(j->events);
+	memset(j, 0, sizeof *j);
+	j->name = name ? strdup(name) : NULL;
+	j->source = source ? strdup(source) : NULL;
+	j->folder = folder ? strdup(folder) : NULL;
+	j->user = strdup(user);
+	j->section = strdup(section);
+	j->id = spool.last + 1;
+	clock_gettime(CLOCK_REALTIME, &j->submitted);
+	record(j, 0, "queued\n");
+	t->job = j;
+	t->tag = tag;
+
+	if ((name && !j->name) || (source && !j->source) || (folder && !j->folder)
+		|| !j->user || !j->section || -1 == stage_rank(&compiler, t, tag, 0)) {
+		free(t);
+		j->done = 1;
+		goto BUSY;
+	}
+	journal_queued(j);
+	spool.last++;
+	pthread_mutex_unlock(&spool.lock);
+	return j->id;
+
+BUSY:
+	if (name)
+		spool.overflow = 1;
+	pthread_mutex_unlock(&spool.lock);
+	return -1;
+}
+
+/*
+	copy what job id said past off into buf; over is
+	set once it is all seen of a finished job, or when
+	the job is forgotten
+*/
+size_t job_events(long id, size_t off, char *buf, size_t size, int *over) {
+	struct job *j = &spool.jobs[id % JUDGED_JOBS];
+	size_t n = 0;
+
+	pthread_mutex_lock(&spool.lock);
+	if (id < 1 || j->id != id)
+		*over = 1;
+	else {
+		n = j->len - off < size ? j->len - off : size;
+		memcpy(buf, j->events + off, n);
+		*over = j->done && off + n == j->len;
+	}
+	pthread_mutex_unlock(&spool.lock);
+	return n;
+}
+
+static int copyFile(const char *from, const char *to, const struct stat *st) {
+	struct timespec times[2] = { st->st_atim, st->st_mtim };
+	off_t off = 0;
+	ssize_t n;
+	int in, out, result = 0;
+
+	if (-1 == (in = open(from, O_RDONLY | O_CLOEXEC)))
+		return -1;
+	if (-1 == (out = open(to, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st->st_mode & 0777))) {
+		close(in);
+		return -1;
+	}
+	while (off < st->st_size)
+		if ((n = sendfile(out, in, &off, st->st_size - off)) <= 0) {
+			result = -1;
+			break;
+		}
+	/* a canonical output goes by the time of its .out */
+	if (-1 == futimens(out, times))
+		result = -1;
+	close(in);
+	return close(out) || result ? -1 : 0;
+}
+
+static void removeData(const char *dir) {
+	char path[PATH_MAX];
+	struct dirent *entry;
+	DIR *d;
+
+	if (NULL == (d = opendir(dir)))
+		return;
+	while ((entry = readdir(d)))
+		if ('.' != *entry->d_name
+			&& sizeof path > snprintf(path, sizeof path, "%s/%s", dir, entry->d_name))
+			unlink(path);
+	closedir(d);
+	rmdir(dir);
+}
+
+/*
+	the files of the folder from, into to; the history
+	of the tests stays in from, for every generation
+*/
+static int copyData(const char *from, const char *to) {
+	char src[PATH_MAX], dst[PATH_MAX], real[PATH_MAX];
+	struct dirent *entry;
+	struct stat st;
+	int result = 0;
+	DIR *d;
+
+	if (NULL == realpath(from, real) || NULL == (d = opendir(from)))
+		return -1;
+	while (0 == result && (entry = readdir(d))) {
+		if ('.' == *entry->d_name || 0 == strcmp(entry->d_name, HISTORY_FILE))
+			continue;
+		if (sizeof src <= snprintf(src, sizeof src, "%s/%s", from, entry->d_name)
+			|| sizeof dst <= snprintf(dst, sizeof dst, "%s/%s", to, entry->d_name))
+			result = -1;
+		else if (0 == stat(src, &st) && S_ISREG(st.st_mode))
+			result = copyFile(src, dst, &st);
+	}
+	closedir(d);
+	if (0 == result && (sizeof src <= snprintf(src, sizeof src, "%s/" HISTORY_FILE, real)
+		|| sizeof dst <= snprintf(dst, sizeof dst, "%s/" HISTORY_FILE, to)
+		|| -1 == symlink(src, dst)))
+		result = -1;
+	return result;
+}
+
+/*
+	a generation of the problem in dir, copied to the
+	spool so that editing dir leaves it be; its version
+	is that of dir, the same for the same files
+*/
+static uint64_t versionOf(const char *dir) {
+	struct problem pb;
+
+	return -1 == problem_load(&pb, dir) ? 0 : problem_version(&pb);
+}
+
+static struct warm *loadProblem(const char *dir) {
+	struct warm *w;
+
+	if (NULL == (w = calloc(1, sizeof *w)))
+		return NULL;
+	strcpy(w->data, "problem.XXXXXX");
+	if (sizeof w->dir <= snprintf(w->dir, sizeof w->dir, "%s", dir)
+		|| 0 == (w->version = versionOf(dir)) || NULL == mkdtemp(w->data)) {
+		free(w);
+		return NULL;
+	}
+	if (-1 == copyData(dir, w->data) || -1 == problem_load(&w->pb, w->data)) {
+		removeData(w->data);
+		free(w);
+		return NULL;
+	}
+	if (*w->pb.checker) {
+		if (-1 == spj_open(&w->spj, &w->pb)) {
+			removeData(w->data);
+			free(w);
+			return NULL;
+		}
+		w->pb.spj = &w->spj;
+	}
+	w->refs = 1;
+	w->wd = -1;
+	return w;
+}
+
+static void freeProblem(struct warm *w) {
+	if (w->pb.spj)
+		spj_close(w->pb.spj);
+	if (remote)
+		remote_forget(w->pb.dir);
+	removeData(w->data);
+	free(w);
+}
+
+/*
+	a generation is gone with the last task judged by it
+*/
+static void putProblem(struct warm *w) {
+	int refs;
+
+	pthread_mutex_lock(&spool.lock);
+	if (0 == (refs = --w->refs))
+		spool.generations--;
+	pthread_mutex_unlock(&spool.lock);
+	if (!refs)
+		freeProblem(w);
+}
+
+static struct warm *current(const char *dir) {
+	struct warm *w;
+
+	for (w = spool.problems; w; w = w->next)
+		if (0 == strcmp(w->dir, dir)) {
+			w->refs++;
+			break;
+		}
+	return w;
+}
+
+/*
+	the current generation of the problem in dir, which
+	the caller is to put; loaded on first use without
+	spool.lock, so that other jobs go on meanwhile, and
+	the first loaded is the one kept
+*/
+static struct warm *warmProblem(const char *dir) {
+	struct warm *w, *fresh;
+	int wd;
+
+	pthread_mutex_lock(&spool.lock);
+	w = current(dir);
+	pthread_mutex_unlock(&spool.lock);
+	if (w)
+		return w;
+
+	/* watched before it is copied, so that no change is missed */
+	wd = inotify_add_watch(spool.notify, dir, IN_CLOSE_WRITE | IN_MOVED_TO
+		| IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ATTRIB);
+	fresh = loadProblem(dir);
+
+	pthread_mutex_lock(&spool.lock);
+	if ((w = current(dir)) || !fresh) {
+		pthread_mutex_unlock(&spool.lock);
+		if (fresh)
+			freeProblem(fresh);
+		return w;
+	}
+	fresh->wd = wd;
+	fresh->refs++;
+	fresh->next = spool.problems;
+	spool.problems = fresh;
+	spool.generations++;
+	pthread_mutex_unlock(&spool.lock);
+
+	/* the events of a change during the copy found no
+	   generation to tell, its version does */
+	if (versionOf(dir) != fresh->version) {
+		pthread_mutex_lock(&spool.lock);
+		fresh->changes++;
+		clock_gettime(CLOCK_REALTIME, &fresh->changed);
+		pthread_mutex_unlock(&spool.lock);
+	}
+	return fresh;
+}
+
+/*
+	a new generation of a problem that changed; it is
+	current from the next job on, unless the folder has
+	changed again meanwhile
+*/
+static void reloadTask(void *arg) {
+	struct warm *w = arg, *fresh, **p;
+
+	fresh = loadProblem(w->dir);
+	pthread_mutex_lock(&spool.lock);
+	w->loading = 0;
+	if (NULL == fresh) {
+		fprintf(stderr, "%s: reload Failed\n", w->dir);
+		/* it is tried again on the next change */
+		w->changes -= w->seen;
+		pthread_mutex_unlock(&spool.lock);
+		return;
+	}
+	if (w->changes != w->seen) {
+		pthread_mutex_unlock(&spool.lock);
+		freeProblem(fresh);
+		return;
+	}
+	for (p = &spool.problems; *p != w; p = &(*p)->next)
+		;
+	*p = fresh;
+	fresh->next = w->next;
+	fresh->wd = w->wd;
+	spool.generations++;
+	spool.reloads++;
+	pthread_mutex_unlock(&spool.lock);
+	putProblem(w);
+}
+
+/*
+	a folder being watched changed, or maybe did if
+	events were lost; what the judge itself writes
+	there is not a change
+*/
+static void problemChanged(const struct inotify_event *event) {
+	struct warm *w;
+
+	if ((event->mask & IN_ISDIR)
+		|| (event->len && 0 == strcmp(event->name, HISTORY_FILE)))
+		return;
+	pthread_mutex_lock(&spool.lock);
+	for (w = spool.problems; w; w = w->next)
+		if (w->wd == event->wd || (event->mask & IN_Q_OVERFLOW)) {
+			w->changes++;
+			clock_gettime(CLOCK_REALTIME, &w->changed);
+		}
+	pthread_mutex_unlock(&spool.lock);
+}
+
+/*
+	problems that changed and have settled are reloaded;
+	whether any is still settling
+*/
+static int reload(void) {
+	struct warm *w;
+	int settling = 0;
+
+	pthread_mutex_lock(&spool.lock);
+	for (w = spool.problems; w; w = w->next) {
+		if (!w->changes || w->loading)
+			continue;
+		if (since(&w->changed) < JUDGED_SETTLE) {
+			settling = 1;
+			continue;
+		}
+		w->seen = w->changes;
+		w->loading = 1;
+		if (-1 == stage_put(&loader, w, 0))
+			w->loading = 0;
+	}
+	pthread_mutex_unlock(&spool.lock);
+	return settling;
+}
+
+/*
+	copy a file to a stream, for the compiler output
+*/
+static void append(FILE *fp, const char *path) {
+	char buf[BUFSIZ];
+	size_t n;
+	FILE *in = fopen(path, "r");
+
+	if (!in)
+		return;
+	while ((n = fread(buf, 1, sizeof buf, in)) > 0)
+		fwrite(buf, 1, n, fp);
+	fclose(in);
+}
+
+/*
+	a job of the spool is taken out of new first
+*/
+static int claim(struct task *t) {
+	char path[PATH_MAX];
+	struct job *j = t->job;
+	struct stat st;
+
+	snprintf(path, sizeof path, "new/%s", j->name);
+	snprintf(t->claimed, sizeof t->claimed, "cur/%s", j->name);
+	/* someone else got it first */
+	if (-1 == rename(path, t->claimed))
+		return -1;
+	/* when it was submitted */
+	if (0 == stat(t->claimed, &st))
+		j->submitted = st.st_mtim;
+	return 0;
+}
+
+static void progress(const struct testcase *tc, void *arg) {
+	emit(arg, 0, "test %d %s %ldms %ldKB\n", tc->num, verdict[tc->result],
+		tc->time, tc->memory);
+}
+
+static void handoff(struct testcase *tc, void *arg) {
+	stage_put(&comparer, tc, 1);
+}
+
+/*
+	the first word on a job, whichever it is
+*/
+static void tell(struct task *t) {
+	if (t->told)
+		return;
+	t->told = 1;
+	pthread_mutex_lock(&spool.lock);
+	spool.feedback[spool.told++ % JUDGED_SAMPLES] = since(&t->job->submitted);
+	pthread_mutex_unlock(&spool.lock);
+}
+
+/*
+	a key of the cache, for a submission to a version
+	of a problem
+*/
+static uint64_t cacheKey(uint64_t submission, uint64_t version) {
+	uint64_t v[2] = { submission, version };
+
+	return hash64(v, sizeof v, 0);
+}
+
+/*
+	the verdict of job origin is this one too
+*/
+static void cached(struct task *t, long origin) {
+	t->cached = 1;
+	fprintf(t->err, "Cached verdict of job %ld\n", origin);
+	emit(t->job, 0, "cached %ld\n", origin);
+}
+
+static void compileTask(void *arg) {
+	struct task *t = arg;
+	struct job *j = t->job;
+	struct warm *w = NULL;
+	uint64_t version = 0;
+	long origin;
+
+	/* a follower whose leader failed, see retry() */
+	if (t->leads) {
+		w = t->w;
+		version = w->version;
+		goto COMPILE;
+	}
+
+	if (j->name && -1 == claim(t)) {
+		journal_finished(j->id);
+		pthread_mutex_lock(&spool.lock);
+		j->done = 1;
+		pthread_mutex_unlock(&spool.lock);
+		free(t);
+		return;
+	}
+	journal_started(j->id);
+
+	t->out = open_memstream(&t->status, &t->status_len);
+	t->err = open_memstream(&t->log, &t->log_len);
+	if (!t->out || !t->err)
+		EXIT_MSG("open_memstream() Failed", EXIT_FAILURE);
+
+	if (j->source && j->folder)
+		w = t->w = warmProblem(j->folder);
+
+	/* the same source was judged, or is being judged */
+	if (w && w->pb.cache && (t->key = compile_key(j->source))) {
+		version = w->version;
+		t->key = cacheKey(t->key, version);
+		switch (vcache_claim(t->key, j->id, t, t->out, t->err, &origin)) {
+		case VCACHE_HIT:
+			cached(t, origin);
+			stage_put(&reporter, t, 1);
+		/* fall through, the leader reports a follower */
+		case VCACHE_FOLLOW:
+			return;
+		}
+		t->leads = 1;
+	}
+
+COMPILE:
+	if (w && 0 == suite_open(&t->suite, w->data, &w->pb))
+		t->opened = 1;
+
+	/* the binary lives in the workspace of the suite */
+	if (!t->opened
+		|| sizeof t->bin <= snprintf(t->bin, sizeof t->bin, "%s/main", t->suite.dir)
+		|| sizeof t->diag <= snprintf(t->diag, sizeof t->diag, "%s/compile.log", t->suite.dir))
+		t->result = SYSTEM_ERROR;
+	else
+		t->result = compile(j->source, t->bin, t->diag);
+
+	if (EXIT_SUCCESS == t->result)
+		t->binary = hash_file(t->bin, 0);
+
+	/* or the same binary, out of another source */
+	if (EXIT_SUCCESS == t->result && t->leads) {
+		t->bin_key = cacheKey(t->binary, version);
+		if (VCACHE_HIT == vcache_lookup(t->bin_key, t->out, t->err, &origin)) {
+			cached(t, origin);
+			stage_put(&reporter, t, 1);
+			return;
+		}
+	}
+
+	if (EXIT_SUCCESS == t->result) {
+		emit(j, 0, "compiled\n");
+		t->suite.progress = progress;
+		t->suite.handoff = handoff;
+		t->suite.arg = j;
+		stage_rank(w->pb.nsamples ? &sampler : &runner, t, t->tag, 1);
+		return;
+	}
+	if (COMPILE_ERROR == t->result) {
+		emit(j, 0, "compile error\n");
+		append(t->err, t->diag);
+	}
+	fprintf(t->out, "%s\n", verdict[t->result]);
+	stage_put(&reporter, t, 1);
+}
+
+/*
+	the samples of the problem are judged as soon as
+	the job compiles, for a preliminary verdict; the
+	rest waits its turn to run
+*/
+static void sampleTask(void *arg) {
+	struct task *t = arg;
+
+	t->result = suite_samples(&t->suite, t->bin, jobs);
+	emit(t->job, 0, "preliminary %s\n", verdict[t->result]);
+	tell(t);
+	stage_rank(&runner, t, t->tag, 1);
+}
+
+static void runTask(void *arg) {
+	struct task *t = arg;
+	struct job *j = t->job;
+	struct timespec start;
+
+	clock_gettime(CLOCK_REALTIME, &start);
+	fair_start(t->tag);
+	fair_waited(j->user, j->section, since(&j->submitted));
+
+	t->remote = remote && -1 != (t->result = remote_run(&t->suite, t->bin, jobs, t->out, t->err));
+	if (!t->remote) {
+		t->result = suite_run(&t->suite, t->bin, jobs);
+		suite_report(&t->suite, t->out, t->err);
+	}
+	fair_ran(j->user, j->folder, since(&start));
+	stage_put(&reporter, t, 1);
+}
+
+static void compareTest(void *arg) {
+	suite_check(arg);
+}
+
+static void reportTask(void *arg);
+
+/*
+	the jobs that followed one the judge failed are not
+	told its verdict but judged after all: the first to
+	claim the key again leads and is queued to compile
+	by the main thread, the rest follow it
+*/
+static void retry(void **followers, int n) {
+	struct task *f;
+	uint64_t one = 1;
+	long origin;
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		f = followers[i];
+		switch (vcache_claim(f->key, f->job->id, f, f->out, f->err, &origin)) {
+		case VCACHE_HIT:
+			cached(f, origin);
+			reportTask(f);
+			break;
+		case VCACHE_MISS:
+			f->leads = 1;
+			pthread_mutex_lock(&spool.lock);
+			if (!spool.retries)
+				spool.retried = &spool.retries;
+			*spool.retried = f;
+			spool.retried = &f->next;
+			pthread_mutex_unlock(&spool.lock);
+			if (8 != write(spool.wake, &one, 8))
+				fprintf(stderr, "eventfd Failed\n");
+			break;
+		}
+	}
+	free(followers);
+}
+
+/*
+	the verdict of a job of the spool is left in done;
+	all are kept among the results of the problem, as
+	judge.sh does, under the user or else the base name
+*/
+static void reportTask(void *arg) {
+	struct task *t = arg, *f;
+	struct job *j = t->job;
+	char path[PATH_MAX], done[PATH_MAX], base[NAME_MAX + 1], *dot;
+	void **followers = NULL;
+	FILE *fp;
+	int i, n = 0, keep;
+
+	fclose(t->out);
+	fclose(t->err);
+
+	/* a system error is not the submission's doing */
+	if (t->leads) {
+		keep = SYSTEM_ERROR != t->result;
+		n = vcache_finish(t->key, t->status, t->log, t->log_len, keep, &followers);
+		if (keep && t->bin_key && !t->cached)
+			vcache_put(t->bin_key, j->id, t->status, t->log, t->log_len);
+	}
+
+	/* obtain base name, strip suffix */
+	snprintf(base, sizeof base, "%s", basename(j->source ? j->source : j->name));
+	if ((dot = strchr(base, '.')))
+		*dot = '\0';
+
+	/* the verdict file appears whole */
+	if (j->name) {
+		snprintf(path, sizeof path, "tmp/%s", j->name);
+		snprintf(done, sizeof done, "done/%s", j->name);
+		if (NULL == (fp = fopen(path, "w"))) {
+			fprintf(stderr, "fopen(%s) Failed\n", path);
+		} else {
+			fprintf(fp, "%s , %s", base, t->status);
+			fwrite(t->log, 1, t->log_len, fp);
+			if (fclose(fp) || -1 == rename(path, done))
+				fprintf(stderr, "rename(%s) Failed\n", done);
+		}
+		unlink(t->claimed);
+	}
+
+	/* the tests too, unless the verdict was reused or
+	   made on a worker */
+	if (j->folder && -1 == resultlog_append(j->folder,
+		strcmp(j->user, JUDGED_USER) ? j->user : base, base, t->result, t->status,
+		t->opened && !t->cached && !t->remote ? &t->suite : NULL, t->binary))
+		fprintf(stderr, "%s: resultlog_append() Failed\n", j->folder);
+	if (t->opened)
+		suite_close(&t->suite);
+	if (t->w)
+		putProblem(t->w);
+
+	journal_finished(j->id);
+	emit(j, 1, "verdict %s", t->status);
+	tell(t);
+	pthread_mutex_lock(&spool.lock);
+	spool.latency[spool.served++ % JUDGED_SAMPLES] = since(&j->submitted);
+	pthread_mutex_unlock(&spool.lock);
+
+	/* the same jobs that waited on this one */
+	if (SYSTEM_ERROR == t->result) {
+		retry(followers, n);
+		n = 0;
+		followers = NULL;
+	}
+	for (i = 0; i < n; ++i) {
+		f = followers[i];
+		fputs(t->status, f->out);
+		fwrite(t->log, 1, t->log_len, f->err);
+		cached(f, j->id);
+		reportTask(f);
+	}
+	free(followers);
+
+	free(t->status);
+	free(t->log);
+	free(t);
+}
+
+/*
+	a job of the spool says what to judge, and for whom
+*/
+static void submit(const char *name) {
+	char path[PATH_MAX], line[3 * PATH_MAX];
+	char source[PATH_MAX], folder[PATH_MAX], user[64], section[64];
+	int n = 0;
+	FILE *fp;
+
+	if ('.' == *name || strlen(name) > NAME_MAX)
+		return;
+	snprintf(path, sizeof path, "new/%s", name);
+	if (NULL != (fp = fopen(path, "r"))) {
+		if (fgets(line, sizeof line, fp))
+			n = sscanf(line, "%4095s %4095s %63s %63s", source, folder, user, section);
+		fclose(fp);
+	}
+	job_new(name, n >= 2 ? source : NULL, n >= 2 ? folder : NULL,
+		n >= 3 ? user : NULL, n >= 4 ? section : NULL);
+}
+
+static void scan(void) {
+	DIR *dir;
+	struct dirent *entry;
+
+	spool.overflow = 0;
+	if (NULL == (dir = opendir("new")))
+		return;
+	while ((entry = readdir(dir)))
+		submit(entry->d_name);
+	closedir(dir);
+}
+
+/*
+	a job from the socket a previous run left
+	unfinished starts over, under a new id
+*/
+static void replay(long id, const char *source, const char *folder,
+	const char *user, const char *section) {
+	struct replay *r;
+
+	if (-1 != job_new(NULL, source, folder, user, section)) {
+		journal_finished(id);
+		return;
+	}
+	/* the queue is full, it is tried again as it drains */
+	if (NULL == (r = calloc(1, sizeof *r))) {
+		fprintf(stderr, "job %ld is left for the next start\n", id);
+		return;
+	}
+	fprintf(stderr, "job %ld waits to be queued again\n", id);
+	r->id = id;
+	snprintf(r->source, sizeof r->source, "%s", source);
+	snprintf(r->folder, sizeof r->folder, "%s", folder);
+	snprintf(r->user, sizeof r->user, "%s", user);
+	snprintf(r->section, sizeof r->section, "%s", section);
+	if (!spool.replays)
+		spool.replayed = &spool.replays;
+	*spool.replayed = r;
+	spool.replayed = &r->next;
+}
+
+static void requeue(void) {
+	struct replay *r;
+	struct task *t;
+
+	/* followers of a failed job first, they waited longest */
+	pthread_mutex_lock(&spool.lock);
+	while ((t = spool.retries) && -1 != stage_rank(&compiler, t, t->tag, 0))
+		spool.retries = t->next;
+	pthread_mutex_unlock(&spool.lock);
+
+	while ((r = spool.replays)
+		&& -1 != job_new(NULL, r->source, r->folder, r->user, r->section)) {
+		journal_finished(r->id);
+		spool.replays = r->next;
+		free(r);
+	}
+}
+
+/*
+	jobs a previous run left unfinished start over
+*/
+static void recover(void) {
+	DIR *dir;
+	struct dirent *entry;
+	char from[PATH_MAX], to[PATH_MAX];
+
+	if (NULL == (dir = opendir("cur")))
+		return;
+	while ((entry = readdir(dir)))
+		if ('.' != *entry->d_name) {
+			snprintf(from, sizeof from, "cur/%s", entry->d_name);
+			snprintf(to, sizeof to, "new/%s", entry->d_name);
+			if (0 == rename(from, to))
+				submit(entry->d_name);
+		}
+	closedir(dir);
+}
+
+static int compareDouble(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+	p50 and p99 of the most recent of n samples in ms,
+	spool.lock held
+*/
+static void percentiles(FILE *fp, const char *what, const double *sample, long n) {
+	double sorted[JUDGED_SAMPLES];
+
+	if (n > JUDGED_SAMPLES)
+		n = JUDGED_SAMPLES;
+	if (!n)
+		return;
+	memcpy(sorted, sample, n * sizeof *sorted);
+	qsort(sorted, n, sizeof *sorted, compareDouble);
+	fprintf(fp, ", %s p50 %.1fms p99 %.1fms", what, sorted[n / 2], sorted[n * 99 / 100]);
+}
+
+/*
+	throughput since start, and percentiles of the time
+	to the verdict and to the first word on a job
+*/
+static void report(FILE *fp) {
+	double elapsed = since(&spool.start) / 1e3;
+	struct warm *w;
+	int n;
+
+	pthread_mutex_lock(&spool.lock);
+	fprintf(fp, "judged: %ld jobs in %.1fs, %.2f/s", spool.served, elapsed,
+		spool.served / elapsed);
+	percentiles(fp, "latency", spool.latency, spool.served);
+	percentiles(fp, "first feedback", spool.feedback, spool.told);
+	pthread_mutex_unlock(&spool.lock);
+	fprintf(fp, "\n");
+
+	stage_report(&compiler, fp);
+	stage_report(&sampler, fp);
+	stage_report(&runner, fp);
+	stage_report(&comparer, fp);
+	stage_report(&reporter, fp);
+	pthread_mutex_lock(&spool.lock);
+	for (n = 0, w = spool.problems; w; w = w->next)
+		n++;
+	fprintf(fp, "problems: %d loaded, %ld reloads, %d older generations in use\n",
+		n, spool.reloads, spool.generations - n);
+	pthread_mutex_unlock(&spool.lock);
+	admit_report(fp);
+	journal_report(fp);
+	vcache_report(fp);
+	compile_report(fp);
+	fair_report(fp);
+	if (remote)
+		remote_report(fp);
+}
+
+void job_stats(FILE *fp) {
+	report(fp);
+}
+
+int main(int argc, char *argv[]) {
+	int opt, i, compilers = 2, samplers = 1, runners = 4, comparers = 2;
+	char buf[1 << 16]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	const char *sub[] = { "tmp", "new", "cur", "done" };
+	struct timespec timeout = { 1, 0 }, settle = { 0, JUDGED_SETTLE * 1000000 };
+	struct sigaction sa;
+	sigset_t mask, old;
+	struct pollfd *pfd;
+	const char *port = NULL, *key = NULL;
+	struct warm *w;
+	struct replay *r;
+	struct dirent **entry;
+	ssize_t len;
+	uint64_t news;
+	int n, notify, fresh, settling = 0;
+
+	while (-1 != (opt = getopt(argc, argv, "c:s:w:m:j:M:p:k:")))
+		if (('c' == opt && (compilers = atoi(optarg)) > 0)
+			|| ('s' == opt && (samplers = atoi(optarg)) > 0)
+			|| ('w' == opt && (runners = atoi(optarg)) > 0)
+			|| ('m' == opt && (comparers = atoi(optarg)) > 0))
+			continue;
+		else if ('M' == opt && (i = atoi(optarg)) > 0)
+			admit_budget((size_t)i << 20);
+		else if ('p' == opt)
+			port = optarg;
+		else if ('k' == opt)
+			key = optarg;
+		else if ('j' != opt || (jobs = atoi(optarg)) < 1)
+			EXIT_MSG(USAGE, EXIT_FAILURE);
+	if (1 != argc - optind || !port != !key)
+		EXIT_MSG(USAGE, EXIT_FAILURE);
+
+	if (-1 == chdir(argv[optind]))
+		EXIT_MSG("chdir() Failed", EXIT_FAILURE);
+	for (i = 0; i < sizeof sub / sizeof *sub; ++i)
+		if (-1 == mkdir(sub[i], 0755) && EEXIST != errno)
+			EXIT_MSG("mkdir() Failed", EXIT_FAILURE);
+	if (-1 == fair_weights(FAIR_WEIGHTS))
+		EXIT_MSG("fair_weights() Failed", EXIT_FAILURE);
+	if (-1 == compile_cache(JUDGED_COMPILED, COMPILE_CACHE_BYTES))
+		EXIT_MSG("compile_cache() Failed", EXIT_FAILURE);
+
+	/* generations of problems a previous run left */
+	if ((n = scandir(".", &entry, NULL, NULL)) >= 0) {
+		while (n--) {
+			if (0 == strncmp(entry[n]->d_name, "problem.", 8))
+				removeData(entry[n]->d_name);
+			free(entry[n]);
+		}
+		free(entry);
+	}
+
+	/* watch before the scan, so that no job slips by;
+	   the folders of problems are watched as they load */
+	if (-1 == (spool.notify = notify = inotify_init1(IN_CLOEXEC))
+		|| -1 == (fresh = inotify_add_watch(notify, "new", IN_MOVED_TO | IN_CLOSE_WRITE)))
+		EXIT_MSG("inotify Failed", EXIT_FAILURE);
+	if (-1 == (spool.wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)))
+		EXIT_MSG("eventfd() Failed", EXIT_FAILURE);
+	if (-1 == api_listen("judged.sock"))
+		EXIT_MSG("api_listen() Failed", EXIT_FAILURE);
+	if (port) {
+		if (-1 == remote_listen(port, key))
+			EXIT_MSG("remote_listen() Failed", EXIT_FAILURE);
+		remote = 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	/* signals are only taken by this thread, in ppoll() */
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = onSignal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGUSR1, &sa, NULL);
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &mask, &old);
+
+	/* downstream first, each stage feeds the next */
+	clock_gettime(CLOCK_REALTIME, &spool.start);
+	if (-1 == stage_start(&loader, "reload", JUDGED_BACKLOG, 1, reloadTask)
+		|| -1 == stage_start(&reporter, "report", JUDGED_BACKLOG, 1, reportTask)
+		|| -1 == stage_start(&comparer, "compare", JUDGED_BACKLOG, comparers, compareTest)
+		|| -1 == stage_start(&runner, "run", JUDGED_BACKLOG, runners, runTask)
+		|| -1 == stage_start(&sampler, "sample", JUDGED_BACKLOG, samplers, sampleTask)
+		|| -1 == stage_start(&compiler, "compile", JUDGED_QUEUE, compilers, compileTask))
+		EXIT_MSG("stage_start() Failed", EXIT_FAILURE);
+	if (-1 == journal_open(JOURNAL_FILE, &spool.last, replay))
+		EXIT_MSG("journal_open() Failed", EXIT_FAILURE);
+	recover();
+	scan();
+
+	while (!stopping) {
+		if (reporting) {
+			reporting = 0;
+			report(stderr);
+		}
+		if (-1 == (n = api_prepare(&pfd, 2)))
+			EXIT_MSG("api_prepare() Failed", EXIT_FAILURE);
+		pfd[0].fd = notify;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = spool.wake;
+		pfd[1].events = POLLIN;
+		if (ppoll(pfd, n, settling ? &settle : &timeout, &old) <= 0) {
+			if (spool.overflow)
+				scan();
+			requeue();
+			settling = reload();
+			continue;
+		}
+
+		api_handle(pfd + 2, n - 2);
+		if (pfd[1].revents && 8 == read(spool.wake, &news, 8))
+			api_flush();
+
+		if (pfd[0].revents && (len = read(notify, buf, sizeof buf)) > 0)
+			for (i = 0; i < len; i += sizeof *event + event->len) {
+				event = (const struct inotify_event *)(buf + i);
+				if (event->mask & IN_Q_OVERFLOW) {
+					spool.overflow = 1;
+					problemChanged(event);
+				} else if (event->wd != fresh)
+					problemChanged(event);
+				else if (event->len)
+					submit(event->name);
+			}
+		if (spool.overflow)
+			scan();
+		requeue();
+		settling = reload();
+	}
+
+	/* finish what has been taken, the rest stays in new */
+	stage_stop(&compiler, 1);
+	stage_stop(&sampler, 0);
+	stage_stop(&runner, 0);
+	stage_stop(&comparer, 0);
+	stage_stop(&reporter, 0);
+	stage_stop(&loader, 1);
+	report(stderr);
+	remote_close();
+	journal_close();
+
+	while ((w = spool.problems)) {
+		spool.problems = w->next;
+		freeProblem(w);
+	}
+	while ((r = spool.replays)) {
+		spool.replays = r->next;
+		free(r);
+	}
+	for (i = 0; i < JUDGED_JOBS; ++i) {
+		free(spool.jobs[i].name);
+		free(spool.jobs[i].source);
+		free(spool.jobs[i].folder);
+		free(spool.jobs[i].user);
+		free(spool.jobs[i].section);
+		free(spool.jobs[i].events);
+	}
+	api_close();
+	close(notify);
+	close(spool.wake);
+	unlink("judged.sock");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,42 @@
+#ifndef JUDGED_H
+#define JUDGED_H
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <poll.h>
+#include <time.h>
+
+/* jobs remembered, running or lately finished */
+#define JUDGED_JOBS 32768
+
+/* whom a job is for when it does not say */
+#define JUDGED_USER "anonymous"
+#define JUDGED_SECTION "default"
+
+/* a job, from the spool or the socket, and what became of it */
+struct job {
+	long id;
+	char *name;		/* in the spool, NULL if from the socket */
+	char *source, *folder;
+	char *user, *section;
+	struct timespec submitted;
+
+	/* one line per event, for whoever watches */
+	char *events;
+	size_t len, cap;
+	int done;
+};
+
+long job_new(const char *name, const char *source, const char *folder,
+	const char *user, const char *section);
+size_t job_events(long id, size_t off, char *buf, size_t size, int *over);
+void job_stats(FILE *fp);
+
+/* the socket side, served from the main thread */
+int api_listen(const char *path);
+int api_prepare(struct pollfd **pfd, int reserved);
+void api_handle(struct pollfd *pfd, int n);
+void api_flush(void);
+void api_close(void);
+
+#endif
@@ -20,386 +20,99 @@
 */
 
 #include "common.h"
+#include "problem.h"
+#include "spj.h"
+#include "judge.h"
+#include "admit.h"
+#include "record.h"
+#include "hash.h"
+#include "resultlog.h"
 
-#define MSG_ERR_RET(msg, res) \
-	do { fprintf(stderr, "%s\n", msg); return(res); } while (0)
+#define USAGE "Usage: judge [-j jobs] [-M memory_mb] [-r records] [-s name] exec_file problem_folder"
 
-#define MSG_JUDGE_QUIT(msg) \
-	do { printf("%s\n", msg); goto FINAL; } while (0)
-
-long Time, Memory;
-
-/*
-	check whether the value in REG_SYS_CALL(x)
-	is amongst the allowed system call list
-*/
-int isAllowedCall(int syscall) {
-	int i;
-
-	for (i = 0; -1 != strace[i]; ++i)
-		if (syscall == strace[i])
-			return 1;
-	return 0;
-}
-
-/*
-	check whether the value in REG_ARG_1(x)
-	is amongst allowed library mapping list
-*/
-int isValidAccess(const char *file) {
-	int i;
-
-	for (i = 0; ltrace[i]; ++i)
-		if (0 == strcmp(file, ltrace[i]))
-			return 1;
-	return 0;
-}
-
-/*
-	a wrap-up function for setting up resource limit
-*/
-
-void setRlimit() {
-	struct rlimit usr_limit;
-
-	usr_limit.rlim_cur = MAX_TIME / 1000;
-	usr_limit.rlim_max = MAX_TIME / 1000 + 1;	// second(s)
-	if (setrlimit(RLIMIT_CPU, &usr_limit))
-		EXIT_MSG("Set Time Limit Failed", SYSTEM_ERROR);
-
-	usr_limit.rlim_cur = MAX_MEMORY;
-	usr_limit.rlim_max = MAX_MEMORY;			// byte(s)
-	if (setrlimit(RLIMIT_AS, &usr_limit))
-		EXIT_MSG("Set Memory Limit Failed", SYSTEM_ERROR);
-}
-
-#define kill_it(pid) ptrace(PTRACE_KILL, pid, NULL, NULL);
-
-int invalidAccess(pid_t pid, struct user_regs_struct *registers) {
-	int i;
-	long access_file[10];
-
-	/* peek which file the process is about to open */
-	for (i = 0; i < 10; i++) {
-		access_file[i] = ptrace(PTRACE_PEEKDATA,
-			pid, REG_ARG_1(registers) + i * sizeof(long), NULL);
-		if (0 == access_file[i])
-			break;
-	}
-	if (!isValidAccess((const char*)access_file)) {
-		kill_it(pid);
-		fprintf(stderr, "%s\t", (const char*)access_file);
-		return 1;
-	}
-	return 0;
-}
-
-/*
-	Given the input file and output file, respectively,
-	decide whether a specified source is satiesfied.
-*/
-int run(const char *bin, const char *in, const char *out) {
-	int result = EXIT_SUCCESS;
-	int status;
-	
-	struct rusage usage;
-	struct user_regs_struct regs;
-	
-	pid_t child = vfork();
-
-	/* assure that parent gets executed after child exits */
-	if (child < 0) {
-		MSG_ERR_RET("vfork() Failed", SYSTEM_ERROR);
-	}
-	/* fork a child to monitor(ptrace) its status */
-	if (0 == child) {
-		int fd[2];
-
-		setRlimit();
-
-		/* dup2 guarantees the atomic operation */
-		
-		if ((fd[0] = open(in, O_RDONLY, 0644)) < 0 || dup2(fd[0], STDIN_FILENO) < 0)
-			EXIT_MSG("dup2(STDIN_FILENO) Failed", SYSTEM_ERROR);
-
-		if ((fd[1] = creat(out, 0644)) < 0 || dup2(fd[1], STDOUT_FILENO) < 0)
-			EXIT_MSG("dup2(STDOUT_FILENO) Failed", SYSTEM_ERROR);
-
-		if (ptrace(PTRACE_TRACEME, 0, NULL, NULL))
-			EXIT_MSG("PTRACE_TRACEME Failed", SYSTEM_ERROR);
-
-		if (-1 == execl(bin, "", NULL))
-			EXIT_MSG("execl() Failed", SYSTEM_ERROR);
-	}
-	for ( ; ; ) {
-		if (-1 == wait4(child, &status, WSTOPPED, &usage))
-			MSG_ERR_RET("wait4() Failed", SYSTEM_ERROR);
-
-		/* child has already exited */
-		if (WIFEXITED(status)) {
-			if (SYSTEM_ERROR == WEXITSTATUS(status))
-				return SYSTEM_ERROR;
-		} else if (SIGTRAP != WSTOPSIG(status)) {
-			kill_it(child);
-			switch (WSTOPSIG(status)) {
-				case SIGSEGV:
-				if (usage.ru_maxrss * (sysconf(_SC_PAGESIZE)) / MAX_MEMORY < 2)
-					result = MEMORY_LIMIT_EXCEEDED;
-				else
-					result = RUNTIME_ERROR;
+int main(int argc, char *argv[], char *env[]) {
+	int opt, jobs = 1, memory, result;
+	const char *folder, *records = NULL, *name = NULL;
+	char *status = NULL;
+	size_t len = 0;
+	uint64_t bin = 0;
+	FILE *fp;
+	struct problem problem;
+	struct spj spj;
+	struct suite suite;
+
+	/*
+		up to jobs test cases run at once, in memory_mb;
+		what records say still holds is not run again,
+		and the verdict is kept among the results of the
+		problem under name
+	*/
+	while (-1 != (opt = getopt(argc, argv, "j:M:r:s:")))
+		switch (opt) {
+			case 'j':
+				if ((jobs = atoi(optarg)) < 1)
+					EXIT_MSG(USAGE, EXIT_FAILURE);
 				break;
-				case SIGALRM: case SIGXCPU: case SIGKILL:
-					result = TIME_LIMIT_EXCEEDED;
+			case 'M':
+				if ((memory = atoi(optarg)) < 1)
+					EXIT_MSG(USAGE, EXIT_FAILURE);
+				admit_budget((size_t)memory << 20);
 				break;
-			}
-		}
-
-		/* unable to peek register info */
-		if (-1 == ptrace(PTRACE_GETREGS, child, NULL, &regs))
-			goto END;
-
-		if (!isAllowedCall(REG_SYS_CALL(&regs))) {
-			kill_it(child);
-			fprintf(stderr, "%llu\t", REG_SYS_CALL(&regs));
-			MSG_ERR_RET("Invalid Syscall", RUNTIME_ERROR);
-		}
-
-		/* watch what the child is going to open */
-		if (SYS_open == REG_SYS_CALL(&regs)) {
-			if (invalidAccess(child, &regs))
-				MSG_ERR_RET("Invalid Access", RUNTIME_ERROR);
+			case 'r':
+				records = optarg;
+				break;
+			case 's':
+				name = optarg;
+				break;
+			default:
+				EXIT_MSG(USAGE, EXIT_FAILURE);
 		}
+	if (2 != argc - optind)
+		EXIT_MSG(USAGE, EXIT_FAILURE);
+	folder = argv[optind + 1];
 
-		/* trace next system call */
-		if (-1 == ptrace(PTRACE_SYSCALL, child, NULL, NULL))
-			MSG_ERR_RET("PTRACE_SYSCALL Failed", SYSTEM_ERROR);
-	}
-END:
-	Time = usage.ru_utime.tv_sec * 1000 + usage.ru_utime.tv_usec / 1000
-		+ usage.ru_stime.tv_sec * 1000 + usage.ru_stime.tv_usec / 1000;
-	Memory = usage.ru_maxrss * (sysconf(_SC_PAGESIZE) / 1024);
-
-	return result;
-}
-
-int diff(const char *s1, const char *s2) {
-	/* test if the same */
-	while (*s1 && *s1 == *s2) {
-		++s1;
-		++s2;
+	if (-1 == problem_load(&problem, folder)) {
+		printf("System Error\n");
+		return EXIT_FAILURE;
 	}
 
-	/* both encounter NUL */
-	if (!(*s1 || *s2))
-		return ACCEPTED;
-
-	for ( ; ; ) {
-		/* skip invisible characters */
-		while (isspace(*s1))
-			s1++;
-		while (isspace(*s2))
-			s2++;
-		/* either is NUL, no need to compare more */
-		if (!(*s1 && *s2))
-			break;
-		/* neither is NUL */
-		if (*s1 != *s2)
-			return WRONG_ANWSER;
-		/* keep running */
-		++s1;
-		++s2;
-	}
-	return (*s1 || *s2) ? WRONG_ANWSER : PRESENTATION_ERROR;
-}
-
-/*
-	when the tested source file has been compiled and
-	successfully produced the output file, this function
-	will perform the answer checking exercise.
-*/
-int check(const char *out, const char *tmp) {
-	int fd[2];
-	int result = ACCEPTED;
-	char *out_mem, *tmp_mem;
-	off_t out_len, tmp_len;
-	
-	if ((fd[0] = open(out, O_RDONLY, 0644)) < 0)
-		MSG_ERR_RET("open(out) Failed.", SYSTEM_ERROR);
-
-	if ((fd[1] = open(tmp, O_RDONLY, 0644)) < 0)
-		MSG_ERR_RET("open(tmp) Failed.", SYSTEM_ERROR);
-
-	/* collect length infomation */
-	out_len = lseek(fd[0], 0, SEEK_END);
-	tmp_len = lseek(fd[1], 0, SEEK_END);
-
-	if (-1 == out_len || -1 == tmp_len)
-		MSG_ERR_RET("lseek() Failed", SYSTEM_ERROR);
-
-	if (MAX_OUTPUT <= tmp_len)
-		return OUTPUT_LIMIT_EXCEEDED;
-
-	/* compare them according to their size */
-	/* both are empty */
-	if (0 == (out_len || tmp_len))
-		return ACCEPTED;
-	/* either is empty */
-	if (0 == (out_len && tmp_len))
-		return WRONG_ANWSER;
-
-	/* rewind */
-	lseek(fd[0], 0, SEEK_SET);
-	lseek(fd[1], 0, SEEK_SET);
-
-	if (-1 == out_len || -1 == tmp_len)
-		MSG_ERR_RET("lseek() or rewind Failed", SYSTEM_ERROR);
-
-	/* map files to memory for efficiency */
-	if ((out_mem = mmap(NULL, out_len, PROT_READ, MAP_PRIVATE, fd[0], 0)) == MAP_FAILED)
-		MSG_ERR_RET("mmap(out_mem) Failed", SYSTEM_ERROR);
-	if ((tmp_mem = mmap(NULL, tmp_len, PROT_READ, MAP_PRIVATE, fd[1], 0)) == MAP_FAILED)
-		MSG_ERR_RET("mmap(tmp_mem) Failed", SYSTEM_ERROR);
-
-	result = diff(out_mem, tmp_mem);
-
-	/* clean */
-	if (-1 == munmap(out_mem, out_len) || -1 == munmap(tmp_mem, tmp_len))
-		MSG_ERR_RET("munmap() Failed", SYSTEM_ERROR);	
-	/* in case of running out of available file descriptors */
-	if (-1 == close(fd[0]) || -1 == close(fd[1]))
-		MSG_ERR_RET("close() Failed", SYSTEM_ERROR);	
-	return result;
-}
-
-/*
-	test if haystack ends with the needle
-*/
-int endWith(const char *haystack, const char *needle) {
-	size_t haystackLen = strlen(haystack);
-	size_t needleLen = strlen(needle);
-
-	if (haystackLen < needleLen)
-		return 0;
-
-	char *end = (char *)haystack + (haystackLen - needleLen);
-	return 0 == strcmp(end, needle);
-}
-
-/*
-	generate a temporary file name
-*/
-void randomString(char str[], const size_t len) {
-	int i;
-
-	srand(time(NULL));
-	for (i = 0; i < len-1; ++i) {
-		str[i] = rand()%26 + 'a'; 
-	}
-	str[len - 1] = '\0';
-}
-
-/*
-	count how many .in files there are in the folder
-*/
-int countFiles(const char *directory, const char *suffix) {
-	int n, cnt = 0;
-	struct dirent **filename;
-
-	n = scandir(directory, &filename, NULL, alphasort);
-	if (n < 0)
-		EXIT_MSG("scandir() Failed", EXIT_FAILURE);
-	else
-		while (n--) {
-			if (endWith(filename[n]->d_name, suffix))
-				++cnt;
-			free(filename[n]);
-		}
-	free(filename);
-	return cnt;
-}
-#define countTestdata(dir) countFiles(dir, ".in")
-
-int getline2(char *s, int lim, FILE *fp) {
-	int c, i = 0;
-	while (i < lim-1 && EOF != (c = fgetc(fp)) && '\n' != c)
-		s[i++] = c;
-	if ('\n' == c)
-		s[i++] = '\0';
-	s[lim - 1] = '\0';
-	return i;
-}
-
-void compare(const char *test_in, const char *test_out, const char *test_tmp) {
-	FILE *in, *out, *tmp;
-	char line_in[MAX_LINE_LEN], line_out[MAX_LINE_LEN], line_tmp[MAX_LINE_LEN];
-
-	in = fopen(test_in, "rm");
-	out = fopen(test_out, "rm");
-	tmp = fopen(test_tmp, "rm");
-
-	if (!in || !out || !tmp)
-		exit(EXIT_FAILURE);
-
-	while (getline2(line_tmp, MAX_LINE_LEN, tmp) && getline2(line_out, MAX_LINE_LEN, out)) {
-		if (getline2(line_in, MAX_LINE_LEN, in) && 0 != strcmp(line_out, line_tmp)) {
-			fprintf(stderr, "Input:^%s$\nOutput:^%s$\nExpected:^%s$\n",
-				line_in, line_tmp, line_out);
-			break;
+	/* load the special judge once for all test cases */
+	if (*problem.checker) {
+		if (-1 == spj_open(&spj, &problem)) {
+			printf("System Error\n");
+			return EXIT_FAILURE;
 		}
+		problem.spj = &spj;
 	}
 
-	if (fclose(in) || fclose(out) || fclose(tmp))
-		EXIT_MSG("fclose() Failed", EXIT_FAILURE);
-}
-
-int main(int argc, char *argv[], char *env[]) {
-	int result = ACCEPTED;
-	int num, total;
-	char test_temp[9];
-	typedef char char32[32];
-	char32 test_in, test_out;
-
-	if (3 != argc)
-		EXIT_MSG("Usage: judge exec_file problem_folder", EXIT_FAILURE);
-
-	randomString(test_temp, sizeof test_temp);
-
-	total = countTestdata(argv[2]);
-
-	for (num = 0; num < total; ++num) {
-		snprintf(test_in ,sizeof test_in, "%s/%d.in", argv[2], num);
-		switch (run(argv[1], test_in, test_temp)) {
-			case SYSTEM_ERROR:
-				MSG_JUDGE_QUIT("System Error");
-			case RUNTIME_ERROR:
-				MSG_JUDGE_QUIT("Runtime Error");
-			case TIME_LIMIT_EXCEEDED:
-				MSG_JUDGE_QUIT("Time Limit Exceeded");
-			case MEMORY_LIMIT_EXCEEDED:
-				MSG_JUDGE_QUIT("Memory Limit Exceeded");
-		}
-
-		snprintf(test_out, sizeof test_out, "%s/%d.out", argv[2], num);
-		switch (check(test_out, test_temp)) {
-			case OUTPUT_LIMIT_EXCEEDED:
-				MSG_JUDGE_QUIT("Output Limit Exceeded");
-			case PRESENTATION_ERROR:
-				MSG_JUDGE_QUIT("Presentation Error");
-			case WRONG_ANWSER:
-				compare(test_in, test_out, test_temp);
-				MSG_JUDGE_QUIT("Wrong Anwser");
-			case SYSTEM_ERROR:
-				MSG_JUDGE_QUIT("System Error");
-			case ACCEPTED: ;
-		}
+	if (-1 == suite_open(&suite, folder, &problem)) {
+		printf("System Error\n");
+		return EXIT_FAILURE;
 	}
+	if (records || name)
+		bin = hash_file(argv[optind], 0);
+	if (records)
+		record_restore(records, &suite, bin);
+	result = suite_run(&suite, argv[optind], jobs);
+	if (!name)
+		suite_report(&suite, stdout, stderr);
+	else if (NULL == (fp = open_memstream(&status, &len)))
+		EXIT_MSG("open_memstream() Failed", EXIT_FAILURE);
+	else {
+		suite_report(&suite, fp, stderr);
+		if (fclose(fp))
+			EXIT_MSG("fclose() Failed", EXIT_FAILURE);
+		fputs(status, stdout);
+		if (-1 == resultlog_append(folder, name, name, result, status, &suite, bin))
+			fprintf(stderr, "%s: resultlog_append() Failed\n", folder);
+		free(status);
+	}
+	if (records && -1 == record_save(records, &suite, bin))
+		fprintf(stderr, "%s: record_save() Failed\n", records);
 
-	if (ACCEPTED == result)
-		printf("Accepted TIME: %ldMS MEM: %ldKB\n", Time, Memory);
-
-FINAL:
 	/* bye for now */
-	if (-1 == unlink(test_temp))
-		MSG_ERR_RET("unlink Failed", SYSTEM_ERROR);
+	suite_close(&suite);
+	if (problem.spj)
+		spj_close(problem.spj);
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,50 @@
+#include "common.h"
+#include "mfile.h"
+
+/*
+	map the file read-only into memory,
+	return 0 on success, -1 on failure
+*/
+int mfile_open(struct mfile *mf, const char *path) {
+	int fd;
+	struct stat st;
+	void *mem = NULL;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return -1;
+
+	if (-1 == fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+
+	/* mmap() refuses zero length, so leave it unmapped */
+	if (st.st_size > 0) {
+		mem = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED == mem) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	/* the mapping outlives the descriptor */
+	if (-1 == close(fd)) {
+		if (mem)
+			munmap(mem, st.st_size);
+		return -1;
+	}
+
+	mf->mem = mem;
+	mf->len = st.st_size;
+	return 0;
+}
+
+int mfile_close(struct mfile *mf) {
+	int ret = 0;
+
+	if (mf->mem)
+		ret = munmap((void *)mf->mem, mf->len);
+	mf->mem = NULL;
+	mf->len = 0;
+	return ret;
+}
@@ -0,0 +1,18 @@
+#ifndef MFILE_H
+#define MFILE_H
+
+#include <stddef.h>
+
+/*
+	a read-only view of a whole file,
+	an empty file maps to (NULL, 0)
+*/
+struct mfile {
+	const char *mem;
+	size_t len;
+};
+
+int mfile_open(struct mfile *mf, const char *path);
+int mfile_close(struct mfile *mf);
+
+#endif
@@ -0,0 +1,334 @@
+/*
+	Diff report for wrong answers: a unified-diff
+	excerpt of how the candidate output departs from
+	the expected one, starting a few lines before the
+	first mismatch and covering at most a window of
+	each output. Lines are aligned with the linear
+	space variant of Myers' O(ND) algorithm (forward
+	and backward searches meeting at a middle snake),
+	and the search gives up once the edit distance or
+	the time spent exceeds a cap, so the cost stays
+	bounded on outputs of any size.
+*/
+
+#include "common.h"
+#include "canon.h"
+#include "hash.h"
+#include "hint.h"
+#include "myers.h"
+
+/* widest line shown in the excerpt */
+#define DIFF_LINE_MAX 160
+
+struct line {
+	const char *ptr;
+	size_t len;		/* without trailing blanks */
+	uint64_t hash;
+};
+
+/* the caps a diff is given up at */
+enum { TOO_MANY = 1, TOO_LONG };
+
+struct context {
+	const struct line *a, *b;
+	char *adel, *bins;	/* changed lines on either side */
+	int *v1, *v2;		/* forward and backward fronts */
+	long edits;
+	struct timespec deadline;
+	int aborted;		/* by which cap, if any */
+};
+
+static inline int same(const struct line *x, const struct line *y) {
+	return x->hash == y->hash && x->len == y->len
+		&& 0 == memcmp(x->ptr, y->ptr, x->len);
+}
+
+static int overdue(struct context *c) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec > c->deadline.tv_sec || (now.tv_sec == c->deadline.tv_sec
+		&& now.tv_nsec > c->deadline.tv_nsec);
+}
+
+/* lines that only one side has */
+static void change(struct context *c, int a0, int n, int b0, int m) {
+	memset(c->adel + a0, 1, n);
+	memset(c->bins + b0, 1, m);
+	if ((c->edits += n + m) > DIFF_MAX_EDITS)
+		c->aborted = TOO_MANY;
+}
+
+static void compareSeq(struct context *c, int a0, int n, int b0, int m);
+
+/*
+	find the middle snake of a[a0, a0+n) and b[b0, b0+m)
+	and recurse on both halves; the fronts are stored in
+	arrays of length n + m + 4, hence linear space
+*/
+static void bisect(struct context *c, int a0, int n, int b0, int m) {
+	const struct line *a = c->a + a0, *b = c->b + b0;
+	int maxd = (n + m + 1) / 2, off = maxd, len = 2 * maxd + 2;
+	int delta = n - m, front = delta & 1;
+	int k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+	int d, k1, k2, x1, y1, x2, y2, i1, i2;
+	int *v1 = c->v1, *v2 = c->v2;
+
+	for (i1 = 0; i1 < len; ++i1)
+		v1[i1] = v2[i1] = -1;
+	v1[off + 1] = v2[off + 1] = 0;
+
+	for (d = 0; d < maxd; ++d) {
+		if (d > DIFF_MAX_EDITS) {
+			c->aborted = TOO_MANY;
+			return;
+		}
+		if (0 == (d & 15) && overdue(c)) {
+			c->aborted = TOO_LONG;
+			return;
+		}
+
+		for (k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+			i1 = off + k1;
+			if (k1 == -d || (k1 != d && v1[i1 - 1] < v1[i1 + 1]))
+				x1 = v1[i1 + 1];
+			else
+				x1 = v1[i1 - 1] + 1;
+			y1 = x1 - k1;
+			while (x1 < n && y1 < m && same(&a[x1], &b[y1]))
+				++x1, ++y1;
+			v1[i1] = x1;
+			if (x1 > n)
+				k1end += 2;
+			else if (y1 > m)
+				k1start += 2;
+			else if (front) {
+				i2 = off + delta - k1;
+				if (i2 >= 0 && i2 < len && -1 != v2[i2] && x1 >= n - v2[i2])
+					goto SPLIT;
+			}
+		}
+
+		for (k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+			i2 = off + k2;
+			if (k2 == -d || (k2 != d && v2[i2 - 1] < v2[i2 + 1]))
+				x2 = v2[i2 + 1];
+			else
+				x2 = v2[i2 - 1] + 1;
+			y2 = x2 - k2;
+			while (x2 < n && y2 < m && same(&a[n - x2 - 1], &b[m - y2 - 1]))
+				++x2, ++y2;
+			v2[i2] = x2;
+			if (x2 > n)
+				k2end += 2;
+			else if (y2 > m)
+				k2start += 2;
+			else if (!front) {
+				i1 = off + delta - k2;
+				if (i1 >= 0 && i1 < len && -1 != v1[i1]) {
+					x1 = v1[i1];
+					y1 = off + x1 - i1;
+					if (x1 >= n - x2)
+						goto SPLIT;
+				}
+			}
+		}
+	}
+
+	/* nothing in common */
+	change(c, a0, n, b0, m);
+	return;
+SPLIT:
+	compareSeq(c, a0, x1, b0, y1);
+	compareSeq(c, a0 + x1, n - x1, b0 + y1, m - y1);
+}
+
+static void compareSeq(struct context *c, int a0, int n, int b0, int m) {
+	if (c->aborted)
+		return;
+
+	/* common prefix and suffix cost nothing */
+	while (n && m && same(&c->a[a0], &c->b[b0]))
+		++a0, ++b0, --n, --m;
+	while (n && m && same(&c->a[a0 + n - 1], &c->b[b0 + m - 1]))
+		--n, --m;
+
+	if (0 == n || 0 == m)
+		change(c, a0, n, b0, m);
+	else
+		bisect(c, a0, n, b0, m);
+}
+
+/*
+	split buf[from, from + window) into whole lines,
+	return how many, or -1 if out of memory
+*/
+static int splitLines(const char *buf, size_t len, size_t from, size_t window,
+	struct line **lines) {
+	const char *p = buf + from, *end, *nl;
+	int n = 0, cap = 64;
+	struct line *v = malloc(cap * sizeof *v), *grown;
+
+	end = len - from > window ? p + window : buf + len;
+	for ( ; v && p < end; p = nl + 1) {
+		if (NULL == (nl = memchr(p, '\n', end - p))) {
+			/* a line cut by the window is left out */
+			if (end != buf + len && n)
+				break;
+			nl = end;
+		}
+		if (n == cap) {
+			if (NULL == (grown = realloc(v, 2 * cap * sizeof *v))) {
+				free(v);
+				return -1;
+			}
+			v = grown;
+			cap *= 2;
+		}
+		v[n].ptr = p;
+		v[n].len = canon_trim(p, nl - p);
+		v[n].hash = hash64(p, v[n].len, 0);
+		++n;
+	}
+	*lines = v;
+	return v ? n : -1;
+}
+
+static void showLine(FILE *fp, char tag, const struct line *l) {
+	if (l->len > DIFF_LINE_MAX)
+		fprintf(fp, "%c%.*s...\n", tag, DIFF_LINE_MAX, l->ptr);
+	else
+		fprintf(fp, "%c%.*s\n", tag, (int)l->len, l->ptr);
+}
+
+/* one line of the edit script */
+struct op {
+	char tag;	/* ' ', '-' or '+' */
+	int i, j;	/* positions on either side before it */
+};
+
+/*
+	print the changes as unified hunks, numbering the
+	lines from the first line of each window
+*/
+static void showHunks(FILE *fp, struct context *c, int n, int m,
+	size_t aline, size_t bline) {
+	struct op *ops;
+	int i = 0, j = 0, k, start, end, run, count, dels, adds;
+
+	if (NULL == (ops = malloc((n + m + 1) * sizeof *ops)))
+		return;
+
+	/* deletions go before insertions at the same spot */
+	for (count = 0; i < n || j < m; ++count) {
+		ops[count].i = i;
+		ops[count].j = j;
+		if (i < n && c->adel[i])
+			ops[count].tag = '-', ++i;
+		else if (j < m && c->bins[j])
+			ops[count].tag = '+', ++j;
+		else
+			ops[count].tag = ' ', ++i, ++j;
+	}
+
+	for (k = 0, end = 0; k < count; k = end) {
+		while (k < count && ' ' == ops[k].tag)
+			++k;
+		if (k == count)
+			break;
+
+		/* changes closer than twice the context share a hunk */
+		start = k - DIFF_CONTEXT > end ? k - DIFF_CONTEXT : end;
+		for (end = k; ; end = run) {
+			while (end < count && ' ' != ops[end].tag)
+				++end;
+			for (run = end; run < count && ' ' == ops[run].tag; ++run)
+				;
+			if (run == count || run - end > 2 * DIFF_CONTEXT) {
+				end = end + DIFF_CONTEXT < count ? end + DIFF_CONTEXT : count;
+				break;
+			}
+		}
+
+		for (dels = adds = 0, i = start; i < end; ++i) {
+			dels += '+' != ops[i].tag;
+			adds += '-' != ops[i].tag;
+		}
+		fprintf(fp, "@@ -%zu,%d +%zu,%d @@\n",
+			aline + ops[start].i, dels, bline + ops[start].j, adds);
+		for (i = start; i < end; ++i)
+			showLine(fp, ops[i].tag,
+				'+' == ops[i].tag ? &c->b[ops[i].j] : &c->a[ops[i].i]);
+	}
+	free(ops);
+}
+
+/* back up DIFF_CONTEXT lines from the line holding at */
+static size_t backUp(const char *buf, size_t at, size_t *lineno) {
+	struct hint_line l;
+	size_t from;
+	int k;
+
+	hint_locate(buf, at, at, &l);
+	from = l.start - buf;
+	*lineno = l.lineno;
+	for (k = 0; k < DIFF_CONTEXT && from > 0; ++k, --*lineno)
+		for (--from; from > 0 && '\n' != buf[from - 1]; --from)
+			;
+	return from;
+}
+
+/*
+	report the differences found within window bytes
+	of each output, starting just before the mismatch
+	at exp_at (expected) and usr_at (candidate)
+*/
+void myers_report(FILE *fp, const char *exp, size_t exp_len, size_t exp_at,
+	const char *usr, size_t usr_len, size_t usr_at, size_t window) {
+	struct context c;
+	struct line *a = NULL, *b = NULL;
+	size_t afrom, bfrom, aline, bline;
+	int n, m;
+
+	memset(&c, 0, sizeof c);
+	afrom = backUp(exp, exp_at, &aline);
+	bfrom = backUp(usr, usr_at, &bline);
+
+	if ((n = splitLines(exp, exp_len, afrom, window, &a)) < 0
+		|| (m = splitLines(usr, usr_len, bfrom, window, &b)) < 0)
+		goto END;
+
+	c.a = a;
+	c.b = b;
+	c.adel = calloc(n + 1, 1);
+	c.bins = calloc(m + 1, 1);
+	c.v1 = malloc((n + m + 4) * sizeof *c.v1);
+	c.v2 = malloc((n + m + 4) * sizeof *c.v2);
+	if (!c.adel || !c.bins || !c.v1 || !c.v2)
+		goto END;
+
+	clock_gettime(CLOCK_MONOTONIC, &c.deadline);
+	c.deadline.tv_nsec += DIFF_MAX_TIME * 1000000L;
+	c.deadline.tv_sec += c.deadline.tv_nsec / 1000000000L;
+	c.deadline.tv_nsec %= 1000000000L;
+
+	compareSeq(&c, 0, n, 0, m);
+	if (TOO_MANY == c.aborted) {
+		fprintf(fp, "Diff: more than %d lines differ\n", DIFF_MAX_EDITS);
+		goto END;
+	}
+	if (TOO_LONG == c.aborted) {
+		fprintf(fp, "Diff: not found in %dms\n", DIFF_MAX_TIME);
+		goto END;
+	}
+
+	fprintf(fp, "--- expected\n+++ output\n");
+	showHunks(fp, &c, n, m, aline, bline);
+END:
+	free(a);
+	free(b);
+	free(c.adel);
+	free(c.bins);
+	free(c.v1);
+	free(c.v2);
+}
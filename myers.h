@@ -0,0 +1,17 @@
+#ifndef MYERS_H
+#define MYERS_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* give up beyond so many changed lines, or so long */
+#define DIFF_MAX_EDITS 200
+#define DIFF_MAX_TIME 50	/* ms */
+
+/* lines of context around each change */
+#define DIFF_CONTEXT 3
+
+void myers_report(FILE *fp, const char *exp, size_t exp_len, size_t exp_at,
+	const char *usr, size_t usr_len, size_t usr_at, size_t window);
+
+#endif
@@ -0,0 +1,86 @@
+#include "common.h"
+
+/* allowed system call list */
+const int strace[] = {
+	SYS_lseek,
+	SYS_mmap,
+	SYS_open,
+	SYS_read,
+	SYS_write,
+	SYS_close,
+	SYS_access,
+	SYS_mprotect,
+	SYS_brk,
+	SYS_uname,
+	SYS_fstat,
+	SYS_execve,
+	SYS_readlink,
+	SYS_arch_prctl,
+	SYS_munmap,
+	SYS_exit_group,
+	-1, /* the end flag */
+};
+
+/* allowed library mapping list */
+const char *ltrace[] = {
+	"/etc/ld.so.cache",
+	/* for C */
+	"/lib/x86_64-linux-gnu/libc.so.6", /* in this case it's on x86-64 */
+	"/lib/x86_64-linux-gnu/libm.so.6",
+	/* for C++ */
+	"/lib/x86_64-linux-gnu/libgcc_s.so.1",
+	"/usr/lib/x86_64-linux-gnu/libstdc++.so.6",
+	NULL, /* the end flag */
+};
+
+/* system calls left to a sandboxed checker, see spj.c */
+const int checker_strace[] = {
+	SYS_read,
+	SYS_write,
+	SYS_recvmsg,
+	SYS_close,
+	SYS_fstat,
+	SYS_newfstatat,
+	SYS_mmap,
+	SYS_munmap,
+	SYS_mremap,
+	SYS_madvise,
+	SYS_brk,
+	SYS_futex,
+	SYS_getrandom,
+	SYS_clock_gettime,
+	SYS_rt_sigreturn,
+	SYS_exit,
+	SYS_exit_group,
+	-1, /* the end flag */
+};
+
+/*
+	left to it while the checker loads, openat() only to
+	read; as filters stack, all of the above must be here
+*/
+const int checker_load_strace[] = {
+	SYS_read,
+	SYS_pread64,
+	SYS_write,
+	SYS_recvmsg,
+	SYS_lseek,
+	SYS_close,
+	SYS_fstat,
+	SYS_newfstatat,
+	SYS_getdents64,
+	SYS_mmap,
+	SYS_mprotect,
+	SYS_munmap,
+	SYS_mremap,
+	SYS_madvise,
+	SYS_brk,
+	SYS_futex,
+	SYS_getrandom,
+	SYS_clock_gettime,
+	SYS_rt_sigreturn,
+	SYS_seccomp,	/* to narrow itself once loaded */
+	SYS_exit,
+	SYS_exit_group,
+	-1, /* the end flag */
+};
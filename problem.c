@@ -0,0 +1,222 @@
+#include "common.h"
+#include "problem.h"
+#include "hash.h"
+
+#define PROBLEM_CONF "problem.conf"
+
+static int parseDouble(const char *value, double *d) {
+	char *end;
+
+	*d = strtod(value, &end);
+	return end != value && '\0' == *end && *d >= 0 ? 0 : -1;
+}
+
+static int parseSize(const char *value, size_t unit, size_t *n) {
+	char *end;
+	unsigned long v = strtoul(value, &end, 10);
+
+	if (end == value || '\0' != *end || '-' == *value)
+		return -1;
+	*n = v * unit;
+	return 0;
+}
+
+static int parseBool(const char *value, int *b) {
+	if (0 == strcmp(value, "yes") || 0 == strcmp(value, "1"))
+		*b = 1;
+	else if (0 == strcmp(value, "no") || 0 == strcmp(value, "0"))
+		*b = 0;
+	else
+		return -1;
+	return 0;
+}
+
+/*
+	a list of test numbers, as "0,1,2"
+*/
+static int parseList(const char *value, int *list, int max, int *n) {
+	char *end;
+	long v;
+
+	for (*n = 0; *n < max; ) {
+		v = strtol(value, &end, 10);
+		if (end == value || v < 0 || v > INT_MAX)
+			return -1;
+		list[(*n)++] = v;
+		if ('\0' == *end)
+			return 0;
+		if (',' != *end)
+			return -1;
+		value = end + 1;
+	}
+	return -1;
+}
+
+/*
+	a group as "points:0-3,7"
+*/
+static int parseGroup(const char *value, struct group *g) {
+	char *end;
+	long from, to;
+
+	memset(g, 0, sizeof *g);
+	g->points = strtol(value, &end, 10);
+	if (end == value || ':' != *end || g->points < 0)
+		return -1;
+	for (value = end + 1; g->nranges < PROBLEM_RANGES; value = end + 1) {
+		from = to = strtol(value, &end, 10);
+		if ('-' == *end)
+			to = strtol(value = end + 1, &end, 10);
+		if (end == value || from < 0 || to < from || to > INT_MAX)
+			return -1;
+		g->from[g->nranges] = from;
+		g->to[g->nranges++] = to;
+		if ('\0' == *end)
+			return 0;
+		if (',' != *end)
+			return -1;
+	}
+	return -1;
+}
+
+static int setKey(struct problem *pb, const char *key, const char *value) {
+	size_t n;
+
+	if (0 == strcmp(key, "compare")) {
+		if (0 == strcmp(value, "exact"))
+			pb->compare = COMPARE_EXACT;
+		else if (0 == strcmp(value, "float"))
+			pb->compare = COMPARE_FLOAT;
+		else if (0 == strcmp(value, "unordered"))
+			pb->compare = COMPARE_UNORDERED;
+		else
+			return -1;
+		return 0;
+	}
+	if (0 == strcmp(key, "abs_eps"))
+		return parseDouble(value, &pb->abs_eps);
+	if (0 == strcmp(key, "rel_eps"))
+		return parseDouble(value, &pb->rel_eps);
+	if (0 == strcmp(key, "checker")) {
+		if ('/' == *value)
+			n = snprintf(pb->checker, sizeof pb->checker, "%s", value);
+		else
+			n = snprintf(pb->checker, sizeof pb->checker, "%s/%s", pb->dir, value);
+		return n < sizeof pb->checker ? 0 : -1;
+	}
+	if (0 == strcmp(key, "checker_trusted"))
+		return parseBool(value, &pb->checker_trusted);
+	if (0 == strcmp(key, "diff_report"))
+		return parseSize(value, 1024, &pb->diff_report);
+	if (0 == strcmp(key, "time_limit")) {
+		if (-1 == parseSize(value, 1, &n) || !n)
+			return -1;
+		pb->time_limit = n;
+		return 0;
+	}
+	if (0 == strcmp(key, "group")) {
+		if (PROBLEM_GROUPS == pb->ngroups
+			|| -1 == parseGroup(value, &pb->groups[pb->ngroups]))
+			return -1;
+		pb->ngroups++;
+		return 0;
+	}
+	if (0 == strcmp(key, "cache"))
+		return parseBool(value, &pb->cache);
+	if (0 == strcmp(key, "samples"))
+		return parseList(value, pb->samples, PROBLEM_SAMPLES, &pb->nsamples);
+	if (0 == strcmp(key, "memory_limit"))
+		return parseSize(value, 1024, &pb->memory_limit) || !pb->memory_limit ? -1 : 0;
+	return -1;
+}
+
+/*
+	fill in the defaults, then override them with
+	whatever the folder's problem.conf says
+*/
+int problem_load(struct problem *pb, const char *dir) {
+	char path[PATH_MAX], line[512], key[64], value[256];
+	int lineno = 0, result = 0;
+	FILE *fp;
+
+	memset(pb, 0, sizeof *pb);
+	snprintf(pb->dir, sizeof pb->dir, "%s", dir);
+	pb->compare = COMPARE_EXACT;
+	pb->abs_eps = 1e-6;
+	pb->rel_eps = 1e-6;
+	pb->time_limit = MAX_TIME;
+	pb->memory_limit = MAX_MEMORY;
+	pb->cache = 1;
+
+	snprintf(path, sizeof path, "%s/" PROBLEM_CONF, dir);
+	if (NULL == (fp = fopen(path, "r")))
+		return ENOENT == errno ? 0 : -1;
+
+	while (fgets(line, sizeof line, fp)) {
+		++lineno;
+		if (1 > sscanf(line, " %63[^=# \t\n]", key))
+			continue;
+		if (2 != sscanf(line, " %63[^= \t] = %255s", key, value)
+			|| -1 == setKey(pb, key, value)) {
+			fprintf(stderr, "%s:%d: bad setting\n", path, lineno);
+			result = -1;
+		}
+	}
+
+	if (fclose(fp))
+		return -1;
+	return result;
+}
+
+int problem_in_group(const struct problem *pb, int g, int num) {
+	int i;
+
+	for (i = 0; i < pb->groups[g].nranges; ++i)
+		if (num >= pb->groups[g].from[i] && num <= pb->groups[g].to[i])
+			return 1;
+	return 0;
+}
+
+/*
+	what the verdicts of the problem depend on: its
+	settings, checker and test files, by name, size and
+	time of change, so that an edit makes a new version
+*/
+static uint64_t fold(const char *path, uint64_t h) {
+	struct stat st;
+	uint64_t v[3];
+
+	if (-1 == stat(path, &st))
+		return h;
+	v[0] = st.st_size;
+	v[1] = st.st_mtim.tv_sec;
+	v[2] = st.st_mtim.tv_nsec;
+	return hash64(v, sizeof v, hash64(path, strlen(path), h));
+}
+
+static int dataFile(const struct dirent *entry) {
+	const char *dot = strrchr(entry->d_name, '.');
+
+	return dot && (0 == strcmp(dot, ".in") || 0 == strcmp(dot, ".out"));
+}
+
+uint64_t problem_version(const struct problem *pb) {
+	char path[PATH_MAX];
+	struct dirent **entry;
+	uint64_t h = 0;
+	int i, n;
+
+	if (sizeof path > snprintf(path, sizeof path, "%s/" PROBLEM_CONF, pb->dir))
+		h = fold(path, h);
+	if (*pb->checker)
+		h = fold(pb->checker, h + 1);
+	if ((n = scandir(pb->dir, &entry, dataFile, alphasort)) < 0)
+		return h;
+	for (i = 0; i < n; ++i) {
+		if (sizeof path > snprintf(path, sizeof path, "%s/%s", pb->dir, entry[i]->d_name))
+			h = fold(path, h);
+		free(entry[i]);
+	}
+	free(entry);
+	return h;
+}
@@ -0,0 +1,83 @@
+#ifndef PROBLEM_H
+#define PROBLEM_H
+
+#include <limits.h>
+#include <stdint.h>
+
+/* sample test cases a problem may mark */
+#define PROBLEM_SAMPLES 16
+
+/* subtask groups, and ranges of tests in each */
+#define PROBLEM_GROUPS 32
+#define PROBLEM_RANGES 8
+
+/* how a candidate output is compared with the expected one */
+enum {
+	COMPARE_EXACT,		/* canonical text, white space gives PE */
+	COMPARE_FLOAT,		/* tokens, numbers within epsilon */
+	COMPARE_UNORDERED,	/* lines in any order */
+};
+
+/*
+	per-problem settings, read from "problem.conf" in
+	the problem folder; every key is optional:
+
+		# comments start with '#'
+		compare = float		# or exact, unordered
+		abs_eps = 1e-6
+		rel_eps = 1e-9
+		checker = checker.so
+		checker_trusted = no
+		diff_report = 64	# KB around a wrong answer
+		time_limit = 1500	# ms of CPU for each test
+		memory_limit = 16384	# KB of address space
+		samples = 0,1		# judged first for a quick answer
+		group = 40:0-3,7	# points for passing all of these
+		cache = no		# always run, e.g. for timing
+*/
+
+/* a subtask, worth its points if every test passes */
+struct group {
+	int points;
+	int nranges;
+	int from[PROBLEM_RANGES], to[PROBLEM_RANGES];
+};
+
+struct problem {
+	char dir[PATH_MAX];
+
+	int compare;
+	double abs_eps;
+	double rel_eps;
+
+	/* special judge, relative to dir, see checker.h */
+	char checker[PATH_MAX];
+	int checker_trusted;
+
+	/* window of the diff report in bytes, 0 for none */
+	size_t diff_report;
+
+	/* limits of a run, in ms and bytes */
+	long time_limit;
+	size_t memory_limit;
+
+	/* test numbers of the samples */
+	int samples[PROBLEM_SAMPLES];
+	int nsamples;
+
+	/* none for all or nothing */
+	struct group groups[PROBLEM_GROUPS];
+	int ngroups;
+
+	/* verdicts may be reused for the same submission */
+	int cache;
+
+	/* the loaded checker, set up by the judge */
+	struct spj *spj;
+};
+
+int problem_load(struct problem *pb, const char *dir);
+int problem_in_group(const struct problem *pb, int g, int num);
+uint64_t problem_version(const struct problem *pb);
+
+#endif
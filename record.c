@@ -0,0 +1,108 @@
+/*
+	Per-test results of a submission, kept so that a
+	rejudge only runs what changed. Each line says what
+	the test was judged with: the binary, the input and
+	expected outputs, the settings of the problem and
+	the limits; a test whose line still matches keeps
+	its verdict without running.
+
+	# test binary test settings ms bytes result time memory
+	0 5c0e... 91d2... 77a0... 1500 16777216 9 12 828
+*/
+
+#include "common.h"
+#include "hash.h"
+#include "canon.h"
+#include "problem.h"
+#include "judge.h"
+#include "record.h"
+
+static uint64_t settings(const struct problem *pb) {
+	char path[PATH_MAX];
+	uint64_t h = 0;
+
+	if (sizeof path > snprintf(path, sizeof path, "%s/problem.conf", pb->dir))
+		h = hash_file(path, h);
+	if (*pb->checker)
+		h = hash_file(pb->checker, h + 1);
+	return h;
+}
+
+/*
+	the input and every expected output of a test
+*/
+static uint64_t testHash(const struct testcase *tc) {
+	char path[PATH_MAX];
+	uint64_t h = hash_file(tc->in, 0);
+	int k;
+
+	for (k = 0; ; ++k) {
+		canon_alt_path(path, sizeof path, tc->out, k);
+		if (-1 == access(path, F_OK))
+			return h;
+		h = hash_file(path, h + k + 1);
+	}
+}
+
+/*
+	take back what still holds from the records at
+	path; returns how many tests need not run
+*/
+int record_restore(const char *path, struct suite *s, uint64_t bin) {
+	char line[256];
+	unsigned long long b, t, c;
+	long time_limit, time, memory;
+	size_t memory_limit;
+	int num, result, restored = 0;
+	uint64_t conf = settings(s->pb);
+	FILE *fp;
+
+	for (num = 0; num < s->total; ++num)
+		s->tc[num].digest = testHash(&s->tc[num]);
+	if (NULL == (fp = fopen(path, "r")))
+		return 0;
+
+	while (fgets(line, sizeof line, fp))
+		if (9 == sscanf(line, "%d %llx %llx %llx %ld %zu %d %ld %ld", &num, &b, &t, &c,
+				&time_limit, &memory_limit, &result, &time, &memory)
+			&& num >= 0 && num < s->total && !s->tc[num].result
+			&& result > SYSTEM_ERROR && result <= ACCEPTED
+			&& bin == b && s->tc[num].digest == t && conf == c
+			&& s->pb->time_limit == time_limit && s->pb->memory_limit == memory_limit) {
+			suite_known(s, num, result, time, memory);
+			restored++;
+		}
+	fclose(fp);
+	return restored;
+}
+
+/*
+	write down every test with a verdict, whole or not
+	at all
+*/
+int record_save(const char *path, const struct suite *s, uint64_t bin) {
+	char tmp[PATH_MAX];
+	uint64_t conf = settings(s->pb);
+	const struct testcase *tc;
+	int num;
+	FILE *fp;
+
+	if (sizeof tmp <= snprintf(tmp, sizeof tmp, "%s.tmp", path)
+		|| NULL == (fp = fopen(tmp, "w")))
+		return -1;
+	fprintf(fp, "# test binary test settings ms bytes result time memory\n");
+	for (num = 0; num < s->total; ++num) {
+		tc = &s->tc[num];
+		if (!tc->result || tc->cancelled || SYSTEM_ERROR == tc->result)
+			continue;
+		fprintf(fp, "%d %016llx %016llx %016llx %ld %zu %d %ld %ld\n", num,
+			(unsigned long long)bin, (unsigned long long)tc->digest,
+			(unsigned long long)conf, s->pb->time_limit, s->pb->memory_limit,
+			tc->result, tc->time, tc->memory);
+	}
+	if (fclose(fp) || -1 == rename(tmp, path)) {
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+
+struct suite;
+
+int record_restore(const char *path, struct suite *s, uint64_t bin);
+int record_save(const char *path, const struct suite *s, uint64_t bin);
+
+#endif
@@ -0,0 +1,20 @@
+#!/bin/bash
+# only aided for Lab Online Judge
+
+# core/rejudge.sh problem_dir user_source.c...
+# judges the sources again after the test data changed;
+# judge.sh only runs the tests whose data, limits or
+# binary differ from what the records of each say
+if [ $# -lt 2 ]; then
+	echo "core/rejudge.sh problem_dir source_file..."
+	exit 0
+fi
+
+folder=`pwd`
+folder=`dirname ${folder}/$0`
+problem=$1
+shift
+
+for source in "$@"; do
+	bash $folder/judge.sh $source $problem
+done
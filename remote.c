@@ -0,0 +1,634 @@
+/*
+	The runs of judged farmed out to workers on other
+	hosts, see worker.c. A worker connects once for each
+	submission it may judge at a time, its slots, and
+	says it is alive every REMOTE_BEAT ms while idle or
+	busy; one silent for REMOTE_TIMEOUT, or gone, loses
+	its slots, and a job it had runs again elsewhere.
+
+	A slot is only taken once the worker proves it has
+	the key of judged, see wire.c, each connection on a
+	thread of its own so that one slow to answer holds
+	up no other:
+
+		hello NAME
+	challenge HEX
+		answer HMAC
+
+	A job goes to a free slot of the worker with the
+	most of them free. It is spoken over the slot like
+	this, worker lines indented:
+
+	problem HASH			the problem, by content
+		have			and it is there already,
+		list			or it is not:
+	HASH SIZE NAME			each file of the folder,
+	end
+		need HASH		those the worker lacks,
+		ready
+	file HASH SIZE			sent one by one, then
+	run JOBS SIZE			the binary, after which
+		test NUM RESULT MS KB	come the tests,
+		done RESULT SIZE SIZE	and the verdict line and
+					diagnostics as judge.sh
+					prints them
+
+	"beat" comes in between whenever. The tests are told
+	once the verdict is in, so that a job tried again
+	elsewhere, or here, tells none twice. Files are kept
+	by their hash on the workers, so that a problem is
+	only sent the first time, and a change to it only
+	sends what changed. The files are problem.conf, the test
+	data and the checker if it lies in the folder; one
+	elsewhere must be at the same path on the workers,
+	as must the libraries of a binary not linked
+	statically.
+*/
+
+#include "common.h"
+#include "problem.h"
+#include "judge.h"
+#include "hash.h"
+#include "wire.h"
+#include "remote.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+
+/* a worker, by the name it says */
+struct node {
+	char name[64];
+	int slots, idle;
+	long jobs, lost;
+	struct node *next;
+};
+
+/* a slot of a worker */
+struct link {
+	struct wire wire;
+	struct node *node;
+	int busy;
+	struct timespec heard;
+	struct link *next;
+};
+
+/* a file of a problem */
+struct item {
+	uint64_t hash;
+	size_t size;
+	char name[NAME_MAX + 1];
+	char path[PATH_MAX];
+};
+
+/* what a version of a problem is made of */
+struct manifest {
+	char folder[PATH_MAX];
+	uint64_t version, hash;
+	struct item *item;
+	int n;
+	struct manifest *next;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t idle;
+	struct link *links;
+	struct node *nodes;
+	long retries;
+	int listener, closing;
+	pthread_t acceptor, monitor;
+
+	/* connections yet to prove their key */
+	struct link *greeting;
+	int greetings;
+	pthread_cond_t greeted;
+
+	pthread_mutex_t packing;
+	struct manifest *manifests;
+} remote = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.idle = PTHREAD_COND_INITIALIZER,
+	.greeted = PTHREAD_COND_INITIALIZER,
+	.packing = PTHREAD_MUTEX_INITIALIZER,
+	.listener = -1,
+};
+
+static double since(const struct timespec *t) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - t->tv_sec) * 1e3 + (now.tv_nsec - t->tv_nsec) / 1e6;
+}
+
+static int packed(const char *name, const struct problem *pb) {
+	const char *dot = strrchr(name, '.');
+	char path[PATH_MAX];
+
+	if (0 == strcmp(name, "problem.conf")
+		|| (dot && (0 == strcmp(dot, ".in") || 0 == strcmp(dot, ".out"))))
+		return 1;
+	return *pb->checker && sizeof path > snprintf(path, sizeof path, "%s/%s", pb->dir, name)
+		&& 0 == strcmp(path, pb->checker);
+}
+
+/*
+	the files of a problem with their hashes, read once
+	for each version of it
+*/
+static struct manifest *pack(const struct problem *pb, uint64_t version) {
+	struct manifest *m;
+	struct dirent **entry;
+	struct item *it;
+	struct stat st;
+	int i, n;
+
+	if ((n = scandir(pb->dir, &entry, NULL, alphasort)) < 0)
+		return NULL;
+	if (NULL == (m = calloc(1, sizeof *m)) || NULL == (m->item = calloc(n, sizeof *m->item))) {
+		free(m);
+		m = NULL;
+	} else {
+		snprintf(m->folder, sizeof m->folder, "%s", pb->dir);
+		m->version = version;
+	}
+	for (i = 0; i < n; ++i) {
+		if (m && '.' != *entry[i]->d_name && packed(entry[i]->d_name, pb)) {
+			it = &m->item[m->n];
+			snprintf(it->name, sizeof it->name, "%s", entry[i]->d_name);
+			if (sizeof it->path > snprintf(it->path, sizeof it->path, "%s/%s",
+				pb->dir, it->name) && 0 == stat(it->path, &st) && S_ISREG(st.st_mode)) {
+				it->size = st.st_size;
+				it->hash = hash_file(it->path, 0);
+				m->hash = hash64(it->name, strlen(it->name), m->hash ^ it->hash);
+				m->n++;
+			}
+		}
+		free(entry[i]);
+	}
+	free(entry);
+	return m;
+}
+
+static const struct manifest *manifest(const struct problem *pb) {
+	uint64_t version = problem_version(pb);
+	struct manifest *m;
+
+	pthread_mutex_lock(&remote.packing);
+	for (m = remote.manifests; m; m = m->next)
+		if (m->version == version && 0 == strcmp(m->folder, pb->dir))
+			break;
+	if (!m && (m = pack(pb, version))) {
+		m->next = remote.manifests;
+		remote.manifests = m;
+	}
+	pthread_mutex_unlock(&remote.packing);
+	return m;
+}
+
+/*
+	a link is let go, remote.lock held
+*/
+static void forget(struct link *l) {
+	struct link **p;
+
+	for (p = &remote.links; *p && *p != l; p = &(*p)->next)
+		;
+	if (*p)
+		*p = l->next;
+	l->node->slots--;
+	if (!l->busy)
+		l->node->idle--;
+	close(l->wire.fd);
+	free(l);
+}
+
+/*
+	whether the worker on a link has the key; beats may
+	come before its answer
+*/
+static int challenge(struct link *l, const char *name) {
+	char line[WIRE_LINE], nonce[WIRE_HEX];
+
+	if (-1 == wire_challenge(nonce)
+		|| -1 == wire_printf(l->wire.fd, "challenge %s\n", nonce))
+		return -1;
+	do
+		if (-1 == wire_line(&l->wire, line, sizeof line, REMOTE_TIMEOUT))
+			return -1;
+	while (0 == strcmp(line, "beat"));
+	return strncmp(line, "answer ", 7) ? -1 : wire_check(nonce, name, line + 7);
+}
+
+/*
+	a connection says who it is and proves its key, on
+	a thread of its own; then it is a slot
+*/
+static void *greet(void *arg) {
+	char line[WIRE_LINE], name[64];
+	struct link *l = arg, **p;
+	struct node *n = NULL;
+	int ok;
+
+	ok = 0 == wire_line(&l->wire, line, sizeof line, REMOTE_TIMEOUT)
+		&& 1 == sscanf(line, "hello %63s", name)
+		&& 0 == challenge(l, name);
+
+	pthread_mutex_lock(&remote.lock);
+	for (p = &remote.greeting; *p != l; p = &(*p)->next)
+		;
+	*p = l->next;
+	remote.greetings--;
+	pthread_cond_broadcast(&remote.greeted);
+
+	if (ok && !remote.closing) {
+		for (n = remote.nodes; n && strcmp(n->name, name); n = n->next)
+			;
+		if (!n && (n = calloc(1, sizeof *n))) {
+			snprintf(n->name, sizeof n->name, "%s", name);
+			n->next = remote.nodes;
+			remote.nodes = n;
+		}
+	}
+	if (n) {
+		n->slots++;
+		n->idle++;
+		l->node = n;
+		clock_gettime(CLOCK_MONOTONIC, &l->heard);
+		l->next = remote.links;
+		remote.links = l;
+		pthread_cond_signal(&remote.idle);
+	} else {
+		close(l->wire.fd);
+		free(l);
+	}
+	pthread_mutex_unlock(&remote.lock);
+	return NULL;
+}
+
+static void *welcome(void *arg) {
+	struct link *l, *oldest;
+	pthread_t greeter;
+	int fd, one = 1;
+
+	for ( ; ; ) {
+		if (-1 == (fd = accept4(remote.listener, NULL, NULL, SOCK_CLOEXEC))) {
+			if (remote.closing)
+				return NULL;
+			continue;
+		}
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+		if (NULL == (l = calloc(1, sizeof *l))) {
+			close(fd);
+			continue;
+		}
+		wire_init(&l->wire, fd);
+
+		/* when too many say nothing, the one waiting longest
+		   makes room; those let go leave at once */
+		pthread_mutex_lock(&remote.lock);
+		if (remote.greetings >= REMOTE_GREETINGS) {
+			for (oldest = remote.greeting; oldest->next; oldest = oldest->next)
+				;
+			shutdown(oldest->wire.fd, SHUT_RDWR);
+		}
+		if (remote.greetings < 2 * REMOTE_GREETINGS
+			&& 0 == pthread_create(&greeter, NULL, greet, l)) {
+			pthread_detach(greeter);
+			remote.greetings++;
+			l->next = remote.greeting;
+			remote.greeting = l;
+			l = NULL;
+		}
+		pthread_mutex_unlock(&remote.lock);
+		if (l) {
+			close(fd);
+			free(l);
+		}
+	}
+}
+
+/*
+	idle slots are heard out here, busy ones by the job
+	on them
+*/
+static void *watch(void *arg) {
+	struct timespec beat = { REMOTE_BEAT / 1000, REMOTE_BEAT % 1000 * 1000000L };
+	char line[WIRE_LINE];
+	struct link *l, *next;
+
+	for ( ; ; ) {
+		nanosleep(&beat, NULL);
+		pthread_mutex_lock(&remote.lock);
+		if (remote.closing) {
+			pthread_mutex_unlock(&remote.lock);
+			return NULL;
+		}
+		for (l = remote.links; l; l = next) {
+			next = l->next;
+			if (l->busy)
+				continue;
+			while (0 == wire_line(&l->wire, line, sizeof line, 0))
+				clock_gettime(CLOCK_MONOTONIC, &l->heard);
+			if (ETIMEDOUT != errno || since(&l->heard) > REMOTE_TIMEOUT)
+				forget(l);
+		}
+		pthread_mutex_unlock(&remote.lock);
+	}
+}
+
+/*
+	listen on "port", of the loopback only, or on
+	"host:port"; key is the file of the shared key
+*/
+int remote_listen(const char *address, const char *key) {
+	struct addrinfo hints, *ai, *p;
+	char host[256] = REMOTE_LOOPBACK;
+	const char *port = strrchr(address, ':');
+	int one = 1;
+
+	if (-1 == wire_key(key))
+		return -1;
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (port && (port - address >= sizeof host || port == address))
+		return -1;
+	if (port)
+		snprintf(host, sizeof host, "%.*s", (int)(port++ - address), address);
+	else
+		port = address;
+	if (getaddrinfo(host, port, &hints, &ai))
+		return -1;
+	for (p = ai; p; p = p->ai_next) {
+		remote.listener = socket(p->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (-1 == remote.listener)
+			continue;
+		if (0 == setsockopt(remote.listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one)
+			&& 0 == bind(remote.listener, p->ai_addr, p->ai_addrlen)
+			&& 0 == listen(remote.listener, SOMAXCONN))
+			break;
+		close(remote.listener);
+		remote.listener = -1;
+	}
+	freeaddrinfo(ai);
+	if (-1 == remote.listener
+		|| pthread_create(&remote.acceptor, NULL, welcome, NULL)
+		|| pthread_create(&remote.monitor, NULL, watch, NULL))
+		return -1;
+	return 0;
+}
+
+/*
+	a free slot of the worker with the most, NULL if
+	there are no workers or none comes up in REMOTE_WAIT
+*/
+static struct link *take(void) {
+	struct timespec deadline;
+	struct link *l, *best;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += REMOTE_WAIT / 1000;
+	pthread_mutex_lock(&remote.lock);
+	for ( ; ; ) {
+		best = NULL;
+		for (l = remote.links; l; l = l->next)
+			if (!l->busy && (!best || l->node->idle > best->node->idle
+				|| (l->node->idle == best->node->idle && l->node->jobs < best->node->jobs)))
+				best = l;
+		if (best || remote.closing || !remote.links
+			|| ETIMEDOUT == pthread_cond_timedwait(&remote.idle, &remote.lock, &deadline))
+			break;
+	}
+	if (best) {
+		best->busy = 1;
+		best->node->idle--;
+	}
+	pthread_mutex_unlock(&remote.lock);
+	return best;
+}
+
+static void give(struct link *l, int ok) {
+	pthread_mutex_lock(&remote.lock);
+	if (ok) {
+		l->busy = 0;
+		l->node->idle++;
+		l->node->jobs++;
+		pthread_cond_signal(&remote.idle);
+	} else {
+		l->node->lost++;
+		remote.retries++;
+		forget(l);
+	}
+	pthread_mutex_unlock(&remote.lock);
+}
+
+/*
+	the next line that is not a heartbeat
+*/
+static int hear(struct link *l, char *line, size_t size) {
+	do
+		if (-1 == wire_line(&l->wire, line, size, REMOTE_TIMEOUT))
+			return -1;
+	while (0 == strcmp(line, "beat"));
+	clock_gettime(CLOCK_MONOTONIC, &l->heard);
+	return 0;
+}
+
+/*
+	the problem, for a worker that lacks it
+*/
+static int ship(struct link *l, const struct manifest *m) {
+	char line[WIRE_LINE];
+	unsigned long long h;
+	int i, k, n = 0, *need;
+	int fd = l->wire.fd, result = -1;
+
+	for (i = 0; i < m->n; ++i)
+		if (-1 == wire_printf(fd, "%016llx %zu %s\n", (unsigned long long)m->item[i].hash,
+			m->item[i].size, m->item[i].name))
+			return -1;
+	if (-1 == wire_printf(fd, "end\n") || NULL == (need = malloc((m->n + 1) * sizeof *need)))
+		return -1;
+
+	/* all that is needed is heard before sending any */
+	while (0 == hear(l, line, sizeof line)) {
+		if (0 == strcmp(line, "ready")) {
+			for (k = 0; k < n; ++k) {
+				i = need[k];
+				if (-1 == wire_printf(fd, "file %016llx %zu\n",
+					(unsigned long long)m->item[i].hash, m->item[i].size)
+					|| -1 == wire_file(fd, m->item[i].path, m->item[i].size))
+					break;
+			}
+			result = k == n ? 0 : -1;
+			break;
+		}
+		if (1 != sscanf(line, "need %llx", &h) || n > m->n)
+			break;
+		for (i = 0; i < m->n && m->item[i].hash != h; ++i)
+			;
+		if (i == m->n)
+			break;
+		need[n++] = i;
+	}
+	free(need);
+	return result;
+}
+
+/*
+	a job on a slot; the verdict is only told once it
+	is all heard, so that a job given up says nothing
+*/
+static int exchange(struct link *l, const struct manifest *m, struct suite *s,
+	const char *bin, int jobs, FILE *out, FILE *err) {
+	char line[WIRE_LINE], *text;
+	struct testcase tc, *heard = NULL, *more;
+	struct stat st;
+	size_t status_len, log_len;
+	int i, n = 0, fd = l->wire.fd, result = -1;
+
+	if (-1 == stat(bin, &st)
+		|| -1 == wire_printf(fd, "problem %016llx\n", (unsigned long long)m->hash)
+		|| -1 == hear(l, line, sizeof line))
+		return -1;
+	if (0 == strcmp(line, "list")) {
+		if (-1 == ship(l, m))
+			return -1;
+	} else if (strcmp(line, "have"))
+		return -1;
+
+	if (-1 == wire_printf(fd, "run %d %lld\n", jobs, (long long)st.st_size)
+		|| -1 == wire_file(fd, bin, st.st_size))
+		return -1;
+	for ( ; ; ) {
+		if (-1 == hear(l, line, sizeof line))
+			break;
+		memset(&tc, 0, sizeof tc);
+		tc.suite = s;
+		if (4 == sscanf(line, "test %d %d %ld %ld", &tc.num, &tc.result, &tc.time, &tc.memory)
+			&& tc.result >= SYSTEM_ERROR && tc.result <= ACCEPTED) {
+			if (NULL == (more = realloc(heard, (n + 1) * sizeof *heard)))
+				break;
+			heard = more;
+			heard[n++] = tc;
+			continue;
+		}
+		if (3 == sscanf(line, "done %d %zu %zu", &result, &status_len, &log_len)
+			&& result >= SYSTEM_ERROR && result <= ACCEPTED)
+			break;
+		result = -1;
+		break;
+	}
+
+	if (-1 != result && NULL == (text = malloc(status_len + log_len + 1)))
+		result = -1;
+	else if (-1 != result) {
+		if (-1 == wire_read(&l->wire, text, status_len + log_len, REMOTE_TIMEOUT))
+			result = -1;
+		else {
+			for (i = 0; i < n && s->progress; ++i)
+				s->progress(&heard[i], s->arg);
+			fwrite(text, 1, status_len, out);
+			fwrite(text + status_len, 1, log_len, err);
+		}
+		free(text);
+	}
+	free(heard);
+	return result;
+}
+
+/*
+	judge s on a worker, as suite_run() and
+	suite_report() would; -1 if none would, and it is
+	to run here
+*/
+int remote_run(struct suite *s, const char *bin, int jobs, FILE *out, FILE *err) {
+	const struct manifest *m = manifest(s->pb);
+	struct link *l;
+	int tries, result;
+
+	if (!m)
+		return -1;
+	for (tries = 0; tries < REMOTE_TRIES && (l = take()); ++tries) {
+		result = exchange(l, m, s, bin, jobs, out, err);
+		give(l, -1 != result);
+		if (-1 != result)
+			return result;
+	}
+	return -1;
+}
+
+/*
+	a problem folder is gone, and what it was made of
+	is no longer needed
+*/
+void remote_forget(const char *folder) {
+	struct manifest **p, *m;
+
+	pthread_mutex_lock(&remote.packing);
+	for (p = &remote.manifests; (m = *p); )
+		if (0 == strcmp(m->folder, folder)) {
+			*p = m->next;
+			free(m->item);
+			free(m);
+		} else
+			p = &m->next;
+	pthread_mutex_unlock(&remote.packing);
+}
+
+void remote_report(FILE *fp) {
+	struct manifest *m;
+	struct node *n;
+	int packs = 0;
+
+	pthread_mutex_lock(&remote.packing);
+	for (m = remote.manifests; m; m = m->next)
+		packs++;
+	pthread_mutex_unlock(&remote.packing);
+
+	pthread_mutex_lock(&remote.lock);
+	for (n = remote.nodes; n; n = n->next)
+		fprintf(fp, "worker %s: %d slots, %d free, %ld jobs, %ld lost\n",
+			n->name, n->slots, n->idle, n->jobs, n->lost);
+	fprintf(fp, "remote: %ld jobs tried again, %d problems packed\n", remote.retries, packs);
+	pthread_mutex_unlock(&remote.lock);
+}
+
+void remote_close(void) {
+	struct manifest *m;
+	struct node *n;
+	struct link *l;
+
+	if (-1 == remote.listener)
+		return;
+	pthread_mutex_lock(&remote.lock);
+	remote.closing = 1;
+	pthread_cond_broadcast(&remote.idle);
+	pthread_mutex_unlock(&remote.lock);
+	shutdown(remote.listener, SHUT_RDWR);
+	pthread_join(remote.acceptor, NULL);
+	pthread_join(remote.monitor, NULL);
+	close(remote.listener);
+
+	/* those still greeting hear the end at once */
+	pthread_mutex_lock(&remote.lock);
+	for (l = remote.greeting; l; l = l->next)
+		shutdown(l->wire.fd, SHUT_RDWR);
+	while (remote.greetings)
+		pthread_cond_wait(&remote.greeted, &remote.lock);
+	pthread_mutex_unlock(&remote.lock);
+
+	while (remote.links)
+		forget(remote.links);
+	while ((n = remote.nodes)) {
+		remote.nodes = n->next;
+		free(n);
+	}
+	while ((m = remote.manifests)) {
+		remote.manifests = m->next;
+		free(m->item);
+		free(m);
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef REMOTE_H
+#define REMOTE_H
+
+#include <stdio.h>
+
+/* where workers are waited for, unless a host is given */
+#define REMOTE_LOOPBACK "127.0.0.1"
+
+/* how often a worker says it is alive, in ms */
+#define REMOTE_BEAT 1000
+
+/* and how long it may say nothing before it is given up */
+#define REMOTE_TIMEOUT (5 * REMOTE_BEAT)
+
+/* connections that may be proving their key at once */
+#define REMOTE_GREETINGS 16
+
+/* workers a job is tried on before it runs here */
+#define REMOTE_TRIES 3
+
+/* how long a job waits for a free slot before that, in ms */
+#define REMOTE_WAIT 30000
+
+struct suite;
+
+int remote_listen(const char *address, const char *key);
+int remote_run(struct suite *s, const char *bin, int jobs, FILE *out, FILE *err);
+void remote_forget(const char *folder);
+void remote_report(FILE *fp);
+void remote_close(void);
+
+#endif
@@ -0,0 +1,698 @@
+/*
+	The results of a problem, kept in RESULTLOG_DIR of
+	its folder as JSON lines, one for each judgement:
+
+	{"at":..,"user":..,"name":..,"result":..,"status":..,
+	 "binary":..,"data":..,"tests":[[num,result,ms,kb],..]}
+
+	with "score" and "total" after the status for a problem
+	scored by groups. A line is written at once to the end
+	of the active segment seg.N, so that judges appending
+	side by side never mix their lines. Past RESULTLOG_SEGMENT
+	the segment is sealed and the next one is begun; what
+	the sealed segment adds is folded into the index then,
+	which holds, sorted by user, where the latest line of
+	each user is and whether the user was ever accepted,
+	along with the count of each verdict.
+
+	A query looks the user up in the index and reads what
+	was appended since, no more than a segment or so. A
+	compaction joins the sealed segments and the archive
+	into a new archive; the index is rebuilt from it, and
+	its rename is what makes the new archive count.
+
+	The lock file is held shared to append or to read and
+	exclusively to seal, fold or compact.
+*/
+
+#include "common.h"
+#include "judge.h"
+#include "problem.h"
+#include "hash.h"
+#include "mfile.h"
+#include "resultlog.h"
+
+#include <sys/file.h>
+#include <stdarg.h>
+
+#define INDEX_MAGIC "RESLOG1"
+
+struct header {
+	char magic[8];
+
+	/* segments below upto are folded in, and those
+	   below base are in the archive as well */
+	int32_t upto, base;
+
+	/* the generation of the archive, -1 for none */
+	int32_t archive, pad;
+
+	int64_t records, accepted_users;
+	int64_t count[RESULTLOG_VERDICTS];
+
+	/* entries that follow */
+	int64_t n;
+};
+
+/* the latest line of a user, in a segment or the archive (-1) */
+struct entry {
+	uint64_t user;
+	int64_t off;
+	int32_t seg, result;
+	int32_t accepted, seq;
+};
+
+/* an index and the entries it maps */
+struct index {
+	struct header h;
+	const struct entry *e;
+	struct mfile mf;
+};
+
+static int path(char *buf, size_t size, const char *folder, const char *fmt, ...) {
+	va_list ap;
+	int n, m;
+
+	n = snprintf(buf, size, "%s/%s/", folder, RESULTLOG_DIR);
+	if (n < 0 || n >= size)
+		return -1;
+	va_start(ap, fmt);
+	m = vsnprintf(buf + n, size - n, fmt, ap);
+	va_end(ap);
+	return m < 0 || m >= size - n ? -1 : 0;
+}
+
+static int writeAll(int fd, const void *buf, size_t len) {
+	ssize_t n;
+
+	for ( ; len; buf = (const char *)buf + n, len -= n)
+		if ((n = write(fd, buf, len)) < 0)
+			return -1;
+	return 0;
+}
+
+/*
+	the lock of the results of folder, taken as asked;
+	the directory is made on first use
+*/
+static int lock(const char *folder, int how) {
+	char buf[PATH_MAX];
+	int fd;
+
+	if (sizeof buf <= snprintf(buf, sizeof buf, "%s/%s", folder, RESULTLOG_DIR)
+		|| (-1 == mkdir(buf, 0755) && EEXIST != errno)
+		|| -1 == path(buf, sizeof buf, folder, "lock")
+		|| -1 == (fd = open(buf, O_RDWR | O_CREAT | O_CLOEXEC, 0644)))
+		return -1;
+	if (-1 == flock(fd, how)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void unlock(int fd) {
+	flock(fd, LOCK_UN);
+	close(fd);
+}
+
+/*
+	the index of folder, an empty one if there is none
+	or it does not add up
+*/
+static void loadIndex(const char *folder, struct index *x) {
+	char buf[PATH_MAX];
+
+	memset(x, 0, sizeof *x);
+	x->h.archive = -1;
+	if (-1 == path(buf, sizeof buf, folder, "index") || -1 == mfile_open(&x->mf, buf))
+		return;
+	if (x->mf.len >= sizeof x->h) {
+		memcpy(&x->h, x->mf.mem, sizeof x->h);
+		if (0 == memcmp(x->h.magic, INDEX_MAGIC, sizeof x->h.magic) && x->h.n >= 0
+			&& x->mf.len == sizeof x->h + x->h.n * sizeof *x->e) {
+			x->e = (const struct entry *)(x->mf.mem + sizeof x->h);
+			return;
+		}
+	}
+	fprintf(stderr, "%s: index Damaged\n", folder);
+	mfile_close(&x->mf);
+	memset(x, 0, sizeof *x);
+	x->h.archive = -1;
+}
+
+static void freeIndex(struct index *x) {
+	if (x->mf.mem || x->mf.len)
+		mfile_close(&x->mf);
+}
+
+/*
+	the segment appended to: the highest there is, and
+	never below what is folded
+*/
+static int active(const char *folder, int upto) {
+	char buf[PATH_MAX];
+	struct dirent *d;
+	DIR *dir;
+	int n, max = upto;
+
+	if (sizeof buf <= snprintf(buf, sizeof buf, "%s/%s", folder, RESULTLOG_DIR)
+		|| NULL == (dir = opendir(buf)))
+		return max;
+	while ((d = readdir(dir)))
+		if (1 == sscanf(d->d_name, "seg.%d", &n) && n > max)
+			max = n;
+	closedir(dir);
+	return max;
+}
+
+static int locate(char *buf, size_t size, const char *folder, int seg, int archive) {
+	return seg < 0 ? path(buf, size, folder, "arc.%d", archive)
+		: path(buf, size, folder, "seg.%06d", seg);
+}
+
+/*
+	the string value of key in a line, as it is written,
+	escapes and all
+*/
+static const char *field(const char *line, size_t len, const char *key, size_t *flen) {
+	const char *p, *q, *end = line + len;
+
+	if (NULL == (p = memmem(line, len, key, strlen(key))))
+		return NULL;
+	for (p += strlen(key), q = p; q < end && '"' != *q; ++q)
+		if ('\\' == *q)
+			++q;
+	if (q >= end)
+		return NULL;
+	*flen = q - p;
+	return p;
+}
+
+/*
+	who a line is of, and its verdict; the fields are
+	read in the order they are written, so that no user
+	or name passes for the verdict
+*/
+static int parse(const char *line, size_t len, uint64_t *user, int *result) {
+	static const char name[] = "\",\"name\":\"", verdict[] = "\",\"result\":";
+	const char *p, *end = line + len;
+	size_t n;
+
+	if (NULL == (p = field(line, len, "\"user\":\"", &n)))
+		return -1;
+	*user = hash64(p, n, 0);
+	p += n;
+	if (end - p < sizeof name - 1 || memcmp(p, name, sizeof name - 1)
+		|| NULL == (p = field(p, end - p, name, &n)))
+		return -1;
+	p += n;
+	if (end - p < sizeof verdict - 1 || memcmp(p, verdict, sizeof verdict - 1))
+		return -1;
+	*result = atoi(p + sizeof verdict - 1);
+	if (*result < 0 || *result >= RESULTLOG_VERDICTS)
+		*result = 0;
+	return 0;
+}
+
+typedef int each_t(const char *line, size_t len, int seg, off_t off, void *arg);
+
+/*
+	each whole line of a segment or of the archive; one
+	torn by a crash is passed over
+*/
+static int scan(const char *folder, int seg, int archive, each_t *fn, void *arg) {
+	char buf[PATH_MAX];
+	struct mfile mf;
+	const char *p, *nl;
+	size_t off;
+	int result = 0;
+
+	if (-1 == locate(buf, sizeof buf, folder, seg, archive))
+		return -1;
+	if (-1 == mfile_open(&mf, buf))
+		return ENOENT == errno ? 0 : -1;
+	for (off = 0; off < mf.len && 0 == result; off = nl + 1 - mf.mem) {
+		p = mf.mem + off;
+		if (NULL == (nl = memchr(p, '\n', mf.len - off)))
+			break;
+		result = fn(p, nl - p, seg, off, arg);
+	}
+	mfile_close(&mf);
+	return result;
+}
+
+/* the lines being folded, in the order they were written */
+struct fold {
+	struct entry *e;
+	int n, cap;
+	int64_t records, count[RESULTLOG_VERDICTS];
+};
+
+static int collect(const char *line, size_t len, int seg, off_t off, void *arg) {
+	struct fold *f = arg;
+	struct entry *more;
+	uint64_t user;
+	int result;
+
+	if (-1 == parse(line, len, &user, &result))
+		return 0;
+	if (f->n == f->cap) {
+		if (NULL == (more = realloc(f->e, (f->cap = 2 * f->cap + 256) * sizeof *more)))
+			return -1;
+		f->e = more;
+	}
+	f->e[f->n] = (struct entry){ user, off, seg, result, ACCEPTED == result, f->n };
+	f->n++;
+	f->records++;
+	f->count[result]++;
+	return 0;
+}
+
+static int compareEntry(const void *a, const void *b) {
+	const struct entry *x = a, *y = b;
+
+	if (x->user != y->user)
+		return x->user < y->user ? -1 : 1;
+	return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/*
+	sorted by user with only the latest line of each,
+	remembering whether any was accepted
+*/
+static void reduce(struct fold *f) {
+	int i, n = 0;
+
+	qsort(f->e, f->n, sizeof *f->e, compareEntry);
+	for (i = 0; i < f->n; ++i) {
+		if (n && f->e[n - 1].user == f->e[i].user) {
+			f->e[i].accepted |= f->e[n - 1].accepted;
+			f->e[n - 1] = f->e[i];
+		} else
+			f->e[n++] = f->e[i];
+	}
+	f->n = n;
+}
+
+/*
+	write the index anew: the entries of the old one,
+	if any, overtaken by those folded
+*/
+static int writeIndex(const char *folder, struct header *h,
+	const struct entry *old, int64_t nold, const struct fold *f) {
+	char tmp[PATH_MAX], buf[PATH_MAX];
+	struct entry *e;
+	int64_t i = 0, j = 0, n = 0;
+	int fd, dir, result = 0;
+
+	if (NULL == (e = malloc((nold + f->n + 1) * sizeof *e)))
+		return -1;
+	h->accepted_users = 0;
+	while (i < nold || j < f->n) {
+		if (j == f->n || (i < nold && old[i].user < f->e[j].user))
+			e[n] = old[i++];
+		else if (i == nold || f->e[j].user < old[i].user)
+			e[n] = f->e[j++];
+		else {
+			e[n] = f->e[j++];
+			e[n].accepted |= old[i++].accepted;
+		}
+		h->accepted_users += e[n++].accepted;
+	}
+	memcpy(h->magic, INDEX_MAGIC, sizeof h->magic);
+	h->n = n;
+
+	if (-1 == path(tmp, sizeof tmp, folder, "index.tmp")
+		|| -1 == path(buf, sizeof buf, folder, "index")
+		|| -1 == (fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))) {
+		free(e);
+		return -1;
+	}
+	if (-1 == writeAll(fd, h, sizeof *h) || -1 == writeAll(fd, e, n * sizeof *e))
+		result = -1;
+	free(e);
+	if (fdatasync(fd) || close(fd) || -1 == result || -1 == rename(tmp, buf))
+		return -1;
+	if (sizeof tmp > snprintf(tmp, sizeof tmp, "%s/%s", folder, RESULTLOG_DIR)
+		&& -1 != (dir = open(tmp, O_RDONLY | O_DIRECTORY | O_CLOEXEC))) {
+		fsync(dir);
+		close(dir);
+	}
+	return 0;
+}
+
+/*
+	with the lock held exclusively, the sealed segments
+	from upto to below seg are folded into the index
+*/
+static int fold(const char *folder, int seg) {
+	struct index x;
+	struct fold f = { NULL, 0, 0, 0, { 0 } };
+	struct header h;
+	int k, result = 0;
+
+	loadIndex(folder, &x);
+	for (k = x.h.upto; k < seg && 0 == result; ++k)
+		result = scan(folder, k, x.h.archive, collect, &f);
+	if (0 == result && x.h.upto < seg) {
+		reduce(&f);
+		h = x.h;
+		h.upto = seg;
+		h.records += f.records;
+		for (k = 0; k < RESULTLOG_VERDICTS; ++k)
+			h.count[k] += f.count[k];
+		result = writeIndex(folder, &h, x.e, x.h.n, &f);
+	}
+	free(f.e);
+	freeIndex(&x);
+	return result;
+}
+
+/*
+	seal the active segment seg, unless someone else did
+	meanwhile
+*/
+static int seal(const char *folder, int seg) {
+	char buf[PATH_MAX];
+	struct index x;
+	int fd, lk, result = 0;
+
+	if (-1 == (lk = lock(folder, LOCK_EX)))
+		return -1;
+	loadIndex(folder, &x);
+	if (seg == active(folder, x.h.upto)) {
+		if (-1 == path(buf, sizeof buf, folder, "seg.%06d", seg + 1)
+			|| -1 == (fd = open(buf, O_WRONLY | O_CREAT | O_CLOEXEC, 0644)))
+			result = -1;
+		else
+			close(fd);
+	}
+	freeIndex(&x);
+	if (0 == result)
+		result = fold(folder, active(folder, 0));
+	unlock(lk);
+	return result;
+}
+
+static void escape(FILE *fp, const char *s, size_t len) {
+	for ( ; len--; ++s) {
+		if ('"' == *s || '\\' == *s)
+			fprintf(fp, "\\%c", *s);
+		else if ((unsigned char)*s < ' ')
+			fprintf(fp, "\\u%04x", (unsigned char)*s);
+		else
+			fputc(*s, fp);
+	}
+}
+
+/*
+	the verdict of a status line, for one whose result
+	is not known otherwise
+*/
+static int verdictOf(const char *status) {
+	int r;
+
+	for (r = ACCEPTED; r >= SYSTEM_ERROR; --r)
+		if (0 == strncmp(status, verdict[r], strlen(verdict[r])))
+			return r;
+	return 0;
+}
+
+/*
+	append the judgement of name by user, status being
+	its verdict line; the suite, if any, gives the tests
+	and bin is the hash of the program, 0 if unknown
+*/
+int resultlog_append(const char *folder, const char *user, const char *name,
+	int result, const char *status, const struct suite *s, uint64_t bin) {
+	char buf[PATH_MAX], *line = NULL;
+	size_t n, len = 0;
+	struct timespec now;
+	struct stat st;
+	int num, points, total, lk, fd, first = 1, seg;
+	struct index x;
+	FILE *fp;
+
+	if (result < SYSTEM_ERROR || result > ACCEPTED)
+		result = verdictOf(status);
+	if (NULL == (fp = open_memstream(&line, &len)))
+		return -1;
+	clock_gettime(CLOCK_REALTIME, &now);
+	fprintf(fp, "{\"at\":%ld.%03ld,\"user\":\"", (long)now.tv_sec, now.tv_nsec / 1000000);
+	escape(fp, user, strlen(user));
+	fprintf(fp, "\",\"name\":\"");
+	escape(fp, name, strlen(name));
+	fprintf(fp, "\",\"result\":%d,\"status\":\"", result);
+	/* a line, less its newline */
+	n = strlen(status);
+	escape(fp, status, n && '\n' == status[n - 1] ? n - 1 : n);
+	fprintf(fp, "\"");
+	if (s && -1 != (points = suite_score(s, &total)))
+		fprintf(fp, ",\"score\":%d,\"total\":%d", points, total);
+	fprintf(fp, ",\"binary\":\"%016llx\",\"data\":\"%016llx\",\"tests\":[",
+		(unsigned long long)bin, (unsigned long long)(s ? problem_version(s->pb) : 0));
+	for (num = 0; s && num < s->total; ++num) {
+		if (!s->tc[num].result)
+			continue;
+		fprintf(fp, "%s[%d,%d,%ld,%ld]", first ? "" : ",", s->tc[num].num,
+			s->tc[num].result, s->tc[num].time, s->tc[num].memory);
+		first = 0;
+	}
+	fprintf(fp, "]}\n");
+	if (fclose(fp)) {
+		free(line);
+		return -1;
+	}
+
+	if (-1 == (lk = lock(folder, LOCK_SH))) {
+		free(line);
+		return -1;
+	}
+	loadIndex(folder, &x);
+	seg = active(folder, x.h.upto);
+	freeIndex(&x);
+	/* one write to the end, whole or not at all */
+	if (-1 == path(buf, sizeof buf, folder, "seg.%06d", seg)
+		|| -1 == (fd = open(buf, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644))) {
+		unlock(lk);
+		free(line);
+		return -1;
+	}
+	result = len == write(fd, line, len) ? 0 : -1;
+	if (-1 == fstat(fd, &st))
+		st.st_size = 0;
+	close(fd);
+	unlock(lk);
+	free(line);
+
+	if (0 == result && st.st_size >= RESULTLOG_SEGMENT)
+		result = seal(folder, seg);
+	return result;
+}
+
+static const struct entry *find(const struct index *x, uint64_t user) {
+	int64_t lo = 0, hi = x->h.n, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (x->e[mid].user < user)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < x->h.n && x->e[lo].user == user ? &x->e[lo] : NULL;
+}
+
+/* the latest line of a user since the index */
+struct latest {
+	const char *user;
+	size_t len;
+	uint64_t key;
+	int found, seg;
+	off_t off;
+};
+
+static int same(const char *line, size_t len, const struct latest *l) {
+	const char *p;
+	size_t n;
+
+	return (p = field(line, len, "\"user\":\"", &n)) && n == l->len && 0 == memcmp(p, l->user, n);
+}
+
+static int newer(const char *line, size_t len, int seg, off_t off, void *arg) {
+	struct latest *l = arg;
+
+	if (same(line, len, l)) {
+		l->found = 1;
+		l->seg = seg;
+		l->off = off;
+	}
+	return 0;
+}
+
+/*
+	print the latest line of user; 1 if there is one,
+	0 if none, -1 on failure
+*/
+int resultlog_latest(const char *folder, const char *user, FILE *out) {
+	char buf[PATH_MAX], *escaped = NULL;
+	struct latest l = { NULL, 0, 0, 0, 0, 0 };
+	const struct entry *e;
+	struct index x;
+	struct mfile mf;
+	const char *nl;
+	int k, n, lk, result = 0;
+	FILE *fp;
+
+	if (NULL == (fp = open_memstream(&escaped, &l.len)))
+		return -1;
+	escape(fp, user, strlen(user));
+	if (fclose(fp)) {
+		free(escaped);
+		return -1;
+	}
+	l.user = escaped;
+	l.key = hash64(escaped, l.len, 0);
+
+	if (-1 == (lk = lock(folder, LOCK_SH))) {
+		free(escaped);
+		return -1;
+	}
+	loadIndex(folder, &x);
+	if ((e = find(&x, l.key))) {
+		l.found = 1;
+		l.seg = e->seg;
+		l.off = e->off;
+	}
+	for (k = x.h.upto, n = active(folder, x.h.upto); k <= n && 0 == result; ++k)
+		result = scan(folder, k, x.h.archive, newer, &l);
+
+	if (0 == result && l.found) {
+		if (-1 == locate(buf, sizeof buf, folder, l.seg, x.h.archive) || -1 == mfile_open(&mf, buf))
+			result = -1;
+		else {
+			if (l.off < mf.len && (nl = memchr(mf.mem + l.off, '\n', mf.len - l.off))
+				&& same(mf.mem + l.off, nl - mf.mem - l.off, &l)) {
+				fwrite(mf.mem + l.off, 1, nl + 1 - mf.mem - l.off, out);
+				result = 1;
+			}
+			mfile_close(&mf);
+		}
+	}
+	freeIndex(&x);
+	unlock(lk);
+	free(escaped);
+	return result;
+}
+
+/*
+	the number of judgements of each verdict, of users,
+	and of those ever accepted
+*/
+int resultlog_stats(const char *folder, struct resultlog_stats *st) {
+	struct fold f = { NULL, 0, 0, 0, { 0 } };
+	const struct entry *e;
+	struct index x;
+	int i, k, n, lk, result = 0;
+
+	if (-1 == (lk = lock(folder, LOCK_SH)))
+		return -1;
+	loadIndex(folder, &x);
+	for (k = x.h.upto, n = active(folder, x.h.upto); k <= n && 0 == result; ++k)
+		result = scan(folder, k, x.h.archive, collect, &f);
+	if (0 == result) {
+		reduce(&f);
+		st->records = x.h.records + f.records;
+		st->users = x.h.n;
+		st->accepted_users = x.h.accepted_users;
+		for (k = 0; k < RESULTLOG_VERDICTS; ++k)
+			st->count[k] = x.h.count[k] + f.count[k];
+		/* those new since the index, or newly accepted */
+		for (i = 0; i < f.n; ++i) {
+			if (NULL == (e = find(&x, f.e[i].user)))
+				st->users++;
+			if (f.e[i].accepted && (NULL == e || !e->accepted))
+				st->accepted_users++;
+		}
+	}
+	free(f.e);
+	freeIndex(&x);
+	unlock(lk);
+	return result;
+}
+
+static int copy(int to, const char *from) {
+	struct mfile mf;
+	int result;
+
+	if (-1 == mfile_open(&mf, from))
+		return ENOENT == errno ? 0 : -1;
+	result = writeAll(to, mf.mem, mf.len);
+	mfile_close(&mf);
+	return result;
+}
+
+/*
+	join the archive and the sealed segments into a new
+	archive, rebuild the index from it, and remove what
+	it replaces
+*/
+int resultlog_compact(const char *folder) {
+	char buf[PATH_MAX], tmp[PATH_MAX];
+	struct fold f = { NULL, 0, 0, 0, { 0 } };
+	struct header h;
+	struct index x;
+	struct dirent *d;
+	DIR *dir;
+	int k, n, fd, lk, result = 0;
+
+	if (-1 == (lk = lock(folder, LOCK_EX)))
+		return -1;
+	loadIndex(folder, &x);
+	/* the segment written to stays, the others are sealed */
+	n = active(folder, x.h.upto);
+
+	memset(&h, 0, sizeof h);
+	h.archive = x.h.archive + 1;
+	h.upto = h.base = n;
+	if (-1 == path(tmp, sizeof tmp, folder, "arc.%d", h.archive)
+		|| -1 == (fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))) {
+		freeIndex(&x);
+		unlock(lk);
+		return -1;
+	}
+	if (x.h.archive >= 0 && (-1 == path(buf, sizeof buf, folder, "arc.%d", x.h.archive)
+		|| -1 == copy(fd, buf)))
+		result = -1;
+	for (k = x.h.base; k < n && 0 == result; ++k)
+		if (-1 == path(buf, sizeof buf, folder, "seg.%06d", k) || -1 == copy(fd, buf))
+			result = -1;
+	if (fdatasync(fd) || close(fd) || -1 == result
+		|| -1 == scan(folder, -1, h.archive, collect, &f)) {
+		unlink(tmp);
+		free(f.e);
+		freeIndex(&x);
+		unlock(lk);
+		return -1;
+	}
+	reduce(&f);
+	h.records = f.records;
+	memcpy(h.count, f.count, sizeof h.count);
+	result = writeIndex(folder, &h, NULL, 0, &f);
+	free(f.e);
+	freeIndex(&x);
+
+	/* what the new archive holds is no longer needed */
+	if (0 == result && sizeof buf > snprintf(buf, sizeof buf, "%s/%s", folder, RESULTLOG_DIR)
+		&& (dir = opendir(buf))) {
+		while ((d = readdir(dir)))
+			if ((1 == sscanf(d->d_name, "seg.%d", &k) && k < n)
+				|| (1 == sscanf(d->d_name, "arc.%d", &k) && k != h.archive))
+				if (0 == path(tmp, sizeof tmp, folder, "%s", d->d_name))
+					unlink(tmp);
+		closedir(dir);
+	}
+	unlock(lk);
+	return result;
+}
@@ -0,0 +1,30 @@
+#ifndef RESULTLOG_H
+#define RESULTLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* the results of a problem, in its folder */
+#define RESULTLOG_DIR "results"
+
+/* a segment is sealed past this size */
+#define RESULTLOG_SEGMENT (1 << 20)
+
+/* verdicts counted, see common.h */
+#define RESULTLOG_VERDICTS 16
+
+struct suite;
+
+/* what the results of a problem add up to */
+struct resultlog_stats {
+	long records, users, accepted_users;
+	long count[RESULTLOG_VERDICTS];
+};
+
+int resultlog_append(const char *folder, const char *user, const char *name,
+	int result, const char *status, const struct suite *s, uint64_t bin);
+int resultlog_latest(const char *folder, const char *user, FILE *out);
+int resultlog_stats(const char *folder, struct resultlog_stats *st);
+int resultlog_compact(const char *folder);
+
+#endif
@@ -0,0 +1,60 @@
+/*
+	Query the results of a problem, see resultlog.c
+
+	results problem latest USER	the latest judgement of USER
+	results problem stats		judgements of each verdict, users
+	results problem compact		fold the sealed segments into the archive
+	results problem add NAME STATUS...	record a judgement made elsewhere
+*/
+
+#include "common.h"
+#include "judge.h"
+#include "resultlog.h"
+
+#define USAGE "Usage: results problem_folder latest user | stats | compact | add name status..."
+
+int main(int argc, char *argv[]) {
+	struct resultlog_stats st;
+	char status[1024];
+	int i, n, len;
+
+	if (argc < 3)
+		EXIT_MSG(USAGE, EXIT_FAILURE);
+
+	if (0 == strcmp(argv[2], "latest") && 4 == argc) {
+		if (-1 == (n = resultlog_latest(argv[1], argv[3], stdout)))
+			EXIT_MSG("latest Failed", EXIT_FAILURE);
+		return n ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (0 == strcmp(argv[2], "stats") && 3 == argc) {
+		if (-1 == resultlog_stats(argv[1], &st))
+			EXIT_MSG("stats Failed", EXIT_FAILURE);
+		printf("%ld judged, %ld users, %ld accepted\n", st.records, st.users, st.accepted_users);
+		for (i = SYSTEM_ERROR; i <= ACCEPTED; ++i)
+			if (st.count[i])
+				printf("%s: %ld\n", verdict[i], st.count[i]);
+		return EXIT_SUCCESS;
+	}
+
+	if (0 == strcmp(argv[2], "compact") && 3 == argc) {
+		if (-1 == resultlog_compact(argv[1]))
+			EXIT_MSG("compact Failed", EXIT_FAILURE);
+		return EXIT_SUCCESS;
+	}
+
+	if (0 == strcmp(argv[2], "add") && argc > 4) {
+		/* the words of the status, as judge.sh has them */
+		for (i = 4, len = 0, *status = '\0'; i < argc; ++i) {
+			n = snprintf(status + len, sizeof status - len, "%s%s", i > 4 ? " " : "", argv[i]);
+			if (n < 0 || n >= sizeof status - len)
+				EXIT_MSG("status Too long", EXIT_FAILURE);
+			len += n;
+		}
+		if (-1 == resultlog_append(argv[1], argv[3], argv[3], 0, status, NULL, 0))
+			EXIT_MSG("add Failed", EXIT_FAILURE);
+		return EXIT_SUCCESS;
+	}
+
+	EXIT_MSG(USAGE, EXIT_FAILURE);
+}
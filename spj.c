@@ -0,0 +1,443 @@
+/*
+	Host side of the special judge ABI in checker.h.
+	A checker is dlopen()ed once per problem, either
+	into the judge itself for trusted course staff, or
+	into spjhost, a helper exec()ed with nothing but its
+	socket open, that confines itself by seccomp before
+	it loads the checker. The helper receives the three
+	files as descriptors and maps them, so no test case
+	costs a process spawn. A helper that crashes or
+	hangs fails the test case it was given, and another
+	is spawned for the next one.
+*/
+
+#include "common.h"
+#include "mfile.h"
+#include "problem.h"
+#include "spj.h"
+
+#include <sys/socket.h>
+#include <sys/prctl.h>
+#include <linux/seccomp.h>
+#include <linux/filter.h>
+#include <linux/audit.h>
+#include <stddef.h>
+#include <limits.h>
+#include <dlfcn.h>
+#include <poll.h>
+
+/* how long one check() may take, in ms */
+#define SPJ_TIMEOUT (MAX_TIME * 4)
+
+/* address space the helper may add to what it starts with */
+#define SPJ_MEMORY (1 << 28)
+
+/* what the helper answers to each test case */
+struct spj_reply {
+	int verdict;
+	char message[SPJ_MESSAGE_LEN];
+};
+
+static int toVerdict(int verdict) {
+	switch (verdict) {
+		case CHECKER_ACCEPTED:
+			return ACCEPTED;
+		case CHECKER_WRONG_ANSWER:
+			return WRONG_ANWSER;
+		case CHECKER_PRESENTATION_ERROR:
+			return PRESENTATION_ERROR;
+	}
+	return SYSTEM_ERROR;
+}
+
+/* why is left in a buffer of SPJ_MESSAGE_LEN on failure */
+static int loadChecker(struct spj *spj, const char *checker, const char *dir, char *why) {
+	checker_init_t *init;
+
+	if (NULL == (spj->handle = dlopen(checker, RTLD_NOW | RTLD_LOCAL))) {
+		snprintf(why, SPJ_MESSAGE_LEN, "%s", dlerror());
+		return -1;
+	}
+	init = (checker_init_t *)dlsym(spj->handle, "init");
+	spj->check = (checker_check_t *)dlsym(spj->handle, "check");
+	spj->fini = (checker_fini_t *)dlsym(spj->handle, "fini");
+
+	if (NULL == spj->check) {
+		snprintf(why, SPJ_MESSAGE_LEN, "%s: no check()", checker);
+		return -1;
+	}
+	if (init && 0 != init(dir)) {
+		snprintf(why, SPJ_MESSAGE_LEN, "%s: init() Failed", checker);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+	from now on, the helper may only make the system
+	calls listed; with readonly, it may also open files
+	but not for writing, as loading the checker needs.
+	Filters stack, so a later call only narrows them.
+*/
+static int confine(const int *calls, int readonly) {
+	int i, n = 0, count;
+
+	for (count = 0; -1 != calls[count]; ++count)
+		;
+
+	struct sock_filter filter[2 * count + 10];
+	struct sock_fprog prog;
+
+	filter[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+		offsetof(struct seccomp_data, arch));
+	filter[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+		AUDIT_ARCH_X86_64, 1, 0);
+	filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_KILL);
+	filter[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+		offsetof(struct seccomp_data, nr));
+	for (i = 0; i < count; ++i) {
+		filter[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+			calls[i], 0, 1);
+		filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+	}
+	if (readonly) {
+		/* openat() if its flags cannot write, the low word of args[2] */
+		filter[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+			SYS_openat, 0, 4);
+		filter[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+			offsetof(struct seccomp_data, args[2]));
+		filter[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K,
+			O_ACCMODE | O_CREAT | O_TRUNC | O_APPEND, 0, 1);
+		filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | EACCES);
+		filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+	}
+	filter[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_KILL);
+
+	prog.len = n;
+	prog.filter = filter;
+	return syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, 0, &prog);
+}
+
+/*
+	the helper: map each (input, expected, output)
+	triple it is handed and answer with the verdict
+*/
+static void serve(struct spj *spj, int sock) {
+	int i, fd[3];
+	char byte;
+	struct stat st;
+	struct span span[3];
+	struct spj_reply reply;
+	struct iovec iov = { &byte, 1 };
+	union {
+		char buf[CMSG_SPACE(sizeof fd)];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+
+	for ( ; ; ) {
+		memset(&msg, 0, sizeof msg);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof control.buf;
+
+		/* the judge has gone */
+		if (recvmsg(sock, &msg, 0) <= 0)
+			break;
+		cmsg = CMSG_FIRSTHDR(&msg);
+		if (NULL == cmsg || cmsg->cmsg_len != CMSG_LEN(sizeof fd))
+			break;
+		memcpy(fd, CMSG_DATA(cmsg), sizeof fd);
+
+		for (i = 0; i < 3; ++i) {
+			span[i].ptr = NULL;
+			span[i].len = 0;
+			if (0 == fstat(fd[i], &st) && st.st_size > 0) {
+				span[i].ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd[i], 0);
+				if (MAP_FAILED == span[i].ptr)
+					span[i].ptr = NULL;
+				else
+					span[i].len = st.st_size;
+			}
+			close(fd[i]);
+		}
+
+		memset(&reply, 0, sizeof reply);
+		reply.verdict = spj->check(span[0], span[1], span[2],
+			reply.message, sizeof reply.message);
+		reply.message[sizeof reply.message - 1] = '\0';
+
+		for (i = 0; i < 3; ++i)
+			if (span[i].ptr)
+				munmap((void *)span[i].ptr, span[i].len);
+
+		if (sizeof reply != write(sock, &reply, sizeof reply))
+			break;
+	}
+	if (spj->fini)
+		spj->fini();
+	_exit(EXIT_SUCCESS);
+}
+
+/*
+	what the process has mapped already, in bytes; the
+	stacks and arenas of a threaded judge count too
+*/
+static long mapped(void) {
+	long pages = 0;
+	FILE *fp = fopen("/proc/self/statm", "r");
+
+	if (fp) {
+		if (1 != fscanf(fp, "%ld", &pages))
+			pages = 0;
+		fclose(fp);
+	}
+	return pages * sysconf(_SC_PAGESIZE);
+}
+
+static int waitReadable(int fd) {
+	struct pollfd pfd = { fd, POLLIN, 0 };
+
+	return 1 == poll(&pfd, 1, SPJ_TIMEOUT) ? 0 : -1;
+}
+
+static void killHelper(struct spj *spj) {
+	if (spj->helper > 0) {
+		kill(spj->helper, SIGKILL);
+		waitpid(spj->helper, NULL, 0);
+		close(spj->sock);
+	}
+	spj->helper = 0;
+	spj->sock = -1;
+}
+
+/*
+	the helper, spjhost: load the checker confined, tell
+	the judge how it went and serve it until it goes
+*/
+int spj_host(const char *checker, const char *dir, int sock) {
+	struct spj spj;
+	struct rlimit limit;
+	char ready[1 + SPJ_MESSAGE_LEN] = "";
+
+	memset(&spj, 0, sizeof spj);
+	limit.rlim_cur = limit.rlim_max = mapped() + SPJ_MEMORY;
+	if (0 != setrlimit(RLIMIT_AS, &limit))
+		snprintf(ready + 1, SPJ_MESSAGE_LEN, "setrlimit() Failed");
+	else if (0 != prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0))
+		snprintf(ready + 1, SPJ_MESSAGE_LEN, "prctl() Failed");
+	else if (0 != confine(checker_load_strace, 1))
+		snprintf(ready + 1, SPJ_MESSAGE_LEN, "seccomp Failed");
+	else if (0 == loadChecker(&spj, checker, dir, ready + 1) && 0 != confine(checker_strace, 0))
+		snprintf(ready + 1, SPJ_MESSAGE_LEN, "seccomp Failed");
+	*ready = '\0' != ready[1];
+
+	if (1 + strlen(ready + 1) != write(sock, ready, 1 + strlen(ready + 1)) || *ready)
+		return SYSTEM_ERROR;
+	serve(&spj, sock);
+	return EXIT_SUCCESS;
+}
+
+/*
+	start the helper on the checker of spj; -1 if it
+	cannot be, or the checker does not load
+*/
+static int spawn(struct spj *spj) {
+	int sv[2];
+	ssize_t n;
+	size_t len;
+	char host[PATH_MAX], ready[1 + SPJ_MESSAGE_LEN + 1], *slash;
+	char *argv[] = { host, spj->checker, spj->dir, NULL };
+
+	/* the helper sits next to the judge */
+	if ((n = readlink("/proc/self/exe", host, sizeof host - 1)) <= 0)
+		return -1;
+	host[n] = '\0';
+	if (NULL == (slash = strrchr(host, '/')))
+		return -1;
+	len = slash + 1 - host;
+	if (sizeof host - len <= snprintf(host + len, sizeof host - len, "%s", SPJ_HOST))
+		return -1;
+
+	if (-1 == socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv))
+		return -1;
+
+	if ((spj->helper = fork()) < 0) {
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+
+	/*
+		the judge may be threaded, so the child only
+		makes system calls until it is spjhost, with
+		the socket as SPJ_SOCK and nothing else open
+	*/
+	if (0 == spj->helper) {
+		if (SPJ_SOCK == sv[1] ? -1 != fcntl(sv[1], F_SETFD, 0)
+			: SPJ_SOCK == dup2(sv[1], SPJ_SOCK)) {
+			close_range(0, SPJ_SOCK - 1, 0);
+			close_range(SPJ_SOCK + 1, ~0U, 0);
+			execv(host, argv);
+		}
+		_exit(SYSTEM_ERROR);
+	}
+
+	close(sv[1]);
+	spj->sock = sv[0];
+
+	/* the helper tells whether the checker is in place, or why not */
+	if (-1 == waitReadable(spj->sock) || (n = read(spj->sock, ready, sizeof ready - 1)) < 1 || *ready) {
+		if (n > 1) {
+			ready[n] = '\0';
+			fprintf(stderr, "%s\n", ready + 1);
+		}
+		killHelper(spj);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+	load the checker of a problem, once; the helper
+	cannot getcwd(), so it is given absolute paths
+*/
+int spj_open(struct spj *spj, const struct problem *pb) {
+	char why[SPJ_MESSAGE_LEN];
+
+	memset(spj, 0, sizeof *spj);
+	spj->sock = -1;
+	pthread_mutex_init(&spj->lock, NULL);
+
+	if (NULL == realpath(pb->checker, spj->checker) || NULL == realpath(pb->dir, spj->dir)) {
+		fprintf(stderr, "%s: realpath() Failed\n", pb->checker);
+		return -1;
+	}
+	if (pb->checker_trusted) {
+		if (-1 == loadChecker(spj, spj->checker, spj->dir, why)) {
+			fprintf(stderr, "%s\n", why);
+			return -1;
+		}
+		return 0;
+	}
+	return spawn(spj);
+}
+
+static int checkInProcess(struct spj *spj, const char *in, const char *out,
+	const char *tmp, char *message) {
+	int i, verdict;
+	const char *path[3] = { in, out, tmp };
+	struct mfile mf[3];
+	struct span span[3];
+
+	for (i = 0; i < 3; ++i) {
+		if (-1 == mfile_open(&mf[i], path[i])) {
+			while (i--)
+				mfile_close(&mf[i]);
+			return SYSTEM_ERROR;
+		}
+		span[i].ptr = mf[i].mem;
+		span[i].len = mf[i].len;
+	}
+
+	verdict = spj->check(span[0], span[1], span[2], message, SPJ_MESSAGE_LEN);
+	message[SPJ_MESSAGE_LEN - 1] = '\0';
+
+	for (i = 0; i < 3; ++i)
+		mfile_close(&mf[i]);
+	return toVerdict(verdict);
+}
+
+static int checkInHelper(struct spj *spj, const char *in, const char *out,
+	const char *tmp, char *message) {
+	int i, fd[3];
+	char byte = 0;
+	const char *path[3] = { in, out, tmp };
+	struct spj_reply reply;
+	struct iovec iov = { &byte, 1 };
+	union {
+		char buf[CMSG_SPACE(sizeof fd)];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	ssize_t n;
+
+	/* the last one crashed or hung */
+	if (spj->sock < 0 && -1 == spawn(spj)) {
+		snprintf(message, SPJ_MESSAGE_LEN, "checker is gone");
+		return SYSTEM_ERROR;
+	}
+
+	for (i = 0; i < 3; ++i)
+		if ((fd[i] = open(path[i], O_RDONLY | O_CLOEXEC)) < 0) {
+			while (i--)
+				close(fd[i]);
+			return SYSTEM_ERROR;
+		}
+
+	memset(&msg, 0, sizeof msg);
+	memset(&control, 0, sizeof control);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof control.buf;
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof fd);
+	memcpy(CMSG_DATA(cmsg), fd, sizeof fd);
+
+	n = sendmsg(spj->sock, &msg, MSG_NOSIGNAL);
+	for (i = 0; i < 3; ++i)
+		close(fd[i]);
+
+	if (1 != n || -1 == waitReadable(spj->sock)
+		|| sizeof reply != read(spj->sock, &reply, sizeof reply)) {
+		/* hung, or killed for a forbidden system call */
+		killHelper(spj);
+		snprintf(message, SPJ_MESSAGE_LEN, "checker crashed or timed out");
+		return SYSTEM_ERROR;
+	}
+
+	memcpy(message, reply.message, SPJ_MESSAGE_LEN);
+	message[SPJ_MESSAGE_LEN - 1] = '\0';
+	return toVerdict(reply.verdict);
+}
+
+/*
+	judge one test case with the checker, the message
+	it leaves (possibly empty) is copied to message
+*/
+int spj_check(struct spj *spj, const char *in, const char *out,
+	const char *tmp, char *message) {
+	int verdict;
+
+	*message = '\0';
+	pthread_mutex_lock(&spj->lock);
+	if (spj->handle)
+		verdict = checkInProcess(spj, in, out, tmp, message);
+	else
+		verdict = checkInHelper(spj, in, out, tmp, message);
+	pthread_mutex_unlock(&spj->lock);
+	return verdict;
+}
+
+void spj_close(struct spj *spj) {
+	if (spj->handle) {
+		if (spj->fini)
+			spj->fini();
+		dlclose(spj->handle);
+		spj->handle = NULL;
+	}
+	if (spj->helper > 0) {
+		/* EOF on the socket lets the helper call fini() */
+		close(spj->sock);
+		waitpid(spj->helper, NULL, 0);
+		spj->helper = 0;
+		spj->sock = -1;
+	}
+	pthread_mutex_destroy(&spj->lock);
+}
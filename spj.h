@@ -0,0 +1,45 @@
+#ifndef SPJ_H
+#define SPJ_H
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <limits.h>
+
+#include "checker.h"
+
+/* the helper a sandboxed checker runs in, next to the judge */
+#define SPJ_HOST "spjhost"
+
+/* the descriptor it talks to the judge over */
+#define SPJ_SOCK 3
+
+/* size of the message a checker may leave */
+#define SPJ_MESSAGE_LEN 256
+
+struct problem;
+
+/* a loaded checker, in-process or behind a helper */
+struct spj {
+	void *handle;
+	checker_check_t *check;
+	checker_fini_t *fini;
+
+	/* the sandboxed helper process, if not trusted */
+	pid_t helper;
+	int sock;
+
+	/* where it loads from, again after a crash */
+	char checker[PATH_MAX];
+	char dir[PATH_MAX];
+
+	/* test cases judged in parallel take turns */
+	pthread_mutex_t lock;
+};
+
+int spj_open(struct spj *spj, const struct problem *pb);
+int spj_check(struct spj *spj, const char *in, const char *out,
+	const char *tmp, char *message);
+void spj_close(struct spj *spj);
+int spj_host(const char *checker, const char *dir, int sock);
+
+#endif
@@ -0,0 +1,18 @@
+/*
+	The helper a checker that is not trusted runs in,
+	see spj.c; the judge exec()s it with its socket as
+	SPJ_SOCK and no other descriptor open.
+
+	spjhost checker_so problem_folder
+*/
+
+#include "common.h"
+#include "spj.h"
+
+#define USAGE "Usage: spjhost checker_so problem_folder"
+
+int main(int argc, char *argv[]) {
+	if (3 != argc)
+		EXIT_MSG(USAGE, EXIT_FAILURE);
+	return spj_host(argv[1], argv[2], SPJ_SOCK);
+}
@@ -0,0 +1,166 @@
+/*
+	A stage of the judging pipeline: items wait in a
+	bounded queue for one of the workers of the stage,
+	first come first served unless they are ranked.
+	A full queue holds up whoever feeds it, so a slow
+	stage slows the ones before it rather than piling
+	up work in memory.
+*/
+
+#include "common.h"
+#include "stage.h"
+
+static double since(const struct timespec *t) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - t->tv_sec) * 1e3 + (now.tv_nsec - t->tv_nsec) / 1e6;
+}
+
+/*
+	the queue is a heap, lowest rank first and in the
+	order of arrival among equals
+*/
+static int before(const struct stage_slot *a, const struct stage_slot *b) {
+	return a->rank != b->rank ? a->rank < b->rank : a->seq < b->seq;
+}
+
+static void siftUp(struct stage *st, int i) {
+	struct stage_slot slot = st->slot[i];
+
+	for ( ; i && before(&slot, &st->slot[(i - 1) / 2]); i = (i - 1) / 2)
+		st->slot[i] = st->slot[(i - 1) / 2];
+	st->slot[i] = slot;
+}
+
+static void siftDown(struct stage *st, int i) {
+	struct stage_slot slot = st->slot[i];
+	int child;
+
+	for ( ; (child = 2 * i + 1) < st->count; i = child) {
+		if (child + 1 < st->count && before(&st->slot[child + 1], &st->slot[child]))
+			child++;
+		if (!before(&st->slot[child], &slot))
+			break;
+		st->slot[i] = st->slot[child];
+	}
+	st->slot[i] = slot;
+}
+
+static void *serve(void *arg) {
+	struct stage *st = arg;
+	void *item;
+	double waited;
+
+	for ( ; ; ) {
+		pthread_mutex_lock(&st->lock);
+		while (!st->count && !st->stop)
+			pthread_cond_wait(&st->nonempty, &st->lock);
+		/* stopping, but what is queued is done first */
+		if (!st->count) {
+			pthread_mutex_unlock(&st->lock);
+			return NULL;
+		}
+		item = st->slot[0].item;
+		waited = since(&st->slot[0].since);
+		if (--st->count) {
+			st->slot[0] = st->slot[st->count];
+			siftDown(st, 0);
+		}
+
+		st->served++;
+		st->waited += waited;
+		if (waited > st->longest)
+			st->longest = waited;
+		pthread_cond_signal(&st->nonfull);
+		pthread_mutex_unlock(&st->lock);
+
+		st->work(item);
+	}
+}
+
+int stage_start(struct stage *st, const char *name, int cap, int workers,
+	void (*work)(void *item)) {
+	memset(st, 0, sizeof *st);
+	st->name = name;
+	st->work = work;
+	st->cap = cap;
+	if (NULL == (st->slot = calloc(cap, sizeof *st->slot))
+		|| NULL == (st->worker = calloc(workers, sizeof *st->worker))) {
+		free(st->slot);
+		return -1;
+	}
+	pthread_mutex_init(&st->lock, NULL);
+	pthread_cond_init(&st->nonempty, NULL);
+	pthread_cond_init(&st->nonfull, NULL);
+
+	for (st->workers = 0; st->workers < workers; ++st->workers)
+		if (pthread_create(&st->worker[st->workers], NULL, serve, st))
+			break;
+	return st->workers ? 0 : -1;
+}
+
+/*
+	queue an item by rank, waiting for room if asked
+	to; returns -1 if it is full and not to wait
+*/
+int stage_rank(struct stage *st, void *item, double rank, int wait) {
+	struct stage_slot *slot;
+
+	pthread_mutex_lock(&st->lock);
+	while (st->cap == st->count && wait)
+		pthread_cond_wait(&st->nonfull, &st->lock);
+	if (st->cap == st->count) {
+		pthread_mutex_unlock(&st->lock);
+		return -1;
+	}
+	slot = &st->slot[st->count];
+	slot->item = item;
+	slot->rank = rank;
+	slot->seq = st->seq++;
+	clock_gettime(CLOCK_MONOTONIC, &slot->since);
+	siftUp(st, st->count);
+	if (++st->count > st->deepest)
+		st->deepest = st->count;
+	pthread_cond_signal(&st->nonempty);
+	pthread_mutex_unlock(&st->lock);
+	return 0;
+}
+
+/*
+	queue an item after those already queued
+*/
+int stage_put(struct stage *st, void *item, int wait) {
+	return stage_rank(st, item, 0, wait);
+}
+
+/*
+	wait for the workers to finish; what is queued is
+	done as well, unless it is to be discarded. The
+	stage can still be reported on afterwards
+*/
+void stage_stop(struct stage *st, int discard) {
+	int i;
+
+	pthread_mutex_lock(&st->lock);
+	st->stop = 1;
+	if (discard)
+		st->count = 0;
+	pthread_cond_broadcast(&st->nonempty);
+	pthread_mutex_unlock(&st->lock);
+
+	for (i = 0; i < st->workers; ++i)
+		pthread_join(st->worker[i], NULL);
+	free(st->worker);
+	st->worker = NULL;
+	st->workers = 0;
+}
+
+void stage_report(struct stage *st, FILE *fp) {
+	pthread_mutex_lock(&st->lock);
+	fprintf(fp, "%s: %d workers, depth %d of %d (deepest %d), %ld served,"
+		" waited %.1fms on average, %.1fms at most\n",
+		st->name, st->workers, st->count, st->cap, st->deepest, st->served,
+		st->served ? st->waited / st->served : 0, st->longest);
+	pthread_mutex_unlock(&st->lock);
+}
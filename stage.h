@@ -0,0 +1,42 @@
+#ifndef STAGE_H
+#define STAGE_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+struct stage_slot {
+	void *item;
+	struct timespec since;
+	double rank;
+	unsigned long seq;
+};
+
+/* a bounded queue, by rank, with a pool of workers of its own */
+struct stage {
+	const char *name;
+	void (*work)(void *item);
+
+	pthread_mutex_t lock;
+	pthread_cond_t nonempty, nonfull;
+	struct stage_slot *slot;
+	int cap, count, stop;
+	unsigned long seq;
+
+	pthread_t *worker;
+	int workers;
+
+	/* how it copes, times in ms */
+	long served;
+	int deepest;
+	double waited, longest;
+};
+
+int stage_start(struct stage *st, const char *name, int cap, int workers,
+	void (*work)(void *item));
+int stage_put(struct stage *st, void *item, int wait);
+int stage_rank(struct stage *st, void *item, double rank, int wait);
+void stage_stop(struct stage *st, int discard);
+void stage_report(struct stage *st, FILE *fp);
+
+#endif
@@ -0,0 +1,28 @@
+#!/bin/bash
+# only aided for Lab Online Judge
+
+# core/submit.sh spool_dir user_source.c problem_dir [user [section]]
+# hands the job to a running judged and waits for it;
+# the queue is shared fairly among users and sections
+if [ $# -lt 3 ] || [ $# -gt 5 ]; then
+	echo "core/submit.sh spool_dir source_file problem_dir [user [section]]"
+	exit 0
+fi
+
+spool=$1
+# the daemon reads paths relative to the spool
+source=`realpath $2`
+problem=`realpath $3`
+
+# a job is renamed into new only once complete
+job=`basename $source`.$$.$RANDOM
+echo $source $problem $4 $5 > $spool/tmp/$job
+mv $spool/tmp/$job $spool/new/$job
+
+while [ ! -e $spool/done/$job ]; do
+	sleep 0.05
+done
+
+# the verdict line, as judge.sh prints it
+head -n 1 $spool/done/$job
+rm $spool/done/$job
@@ -0,0 +1,7 @@
+#include <stdio.h>
+
+int main() {
+	double a, b;
+	while (2 == scanf("%lf%lf", &a, &b))
+		printf("%.9f\n", a / b);
+}
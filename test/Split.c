@@ -0,0 +1,7 @@
+#include <stdio.h>
+
+int main() {
+	int n;
+	while (1 == scanf("%d", &n))
+		printf("%d %d\n", n / 2, n - n / 2);
+}
@@ -0,0 +1,41 @@
+/*
+	A sample special judge: print any two positive
+	integers whose sum is the given n.
+
+	gcc -shared -fPIC -o checker.so checker.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../checker.h"
+
+/* the spans are not NUL-terminated */
+static long parse(struct span s, size_t *pos) {
+	char buf[32];
+	size_t i = 0;
+
+	while (*pos < s.len && (' ' == s.ptr[*pos] || '\n' == s.ptr[*pos]))
+		++*pos;
+	while (*pos < s.len && i < sizeof buf - 1 && ' ' != s.ptr[*pos] && '\n' != s.ptr[*pos])
+		buf[i++] = s.ptr[(*pos)++];
+	buf[i] = '\0';
+	return i ? strtol(buf, NULL, 10) : -1;
+}
+
+int check(struct span input, struct span expected, struct span output,
+	char *message, size_t size) {
+	size_t in = 0, out = 0;
+	long n, a, b;
+
+	while ((n = parse(input, &in)) > 0) {
+		a = parse(output, &out);
+		b = parse(output, &out);
+		if (a <= 0 || b <= 0 || a + b != n) {
+			snprintf(message, size, "%ld + %ld is not %ld", a, b, n);
+			return CHECKER_WRONG_ANSWER;
+		}
+	}
+	return CHECKER_ACCEPTED;
+}
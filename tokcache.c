@@ -0,0 +1,158 @@
+/*
+	Pre-tokenized expected outputs, kept resident by a
+	long-running judge so that hundreds of submissions
+	to one problem tokenize its outputs only once.
+	Entries are keyed by the content hash of the text,
+	reference counted, and the least recently used ones
+	are dropped once the memory budget is exceeded.
+*/
+
+#include <pthread.h>
+
+#include "common.h"
+#include "tokcache.h"
+#include "hash.h"
+
+#define TOKCACHE_BUCKETS 1024
+
+struct entry {
+	struct tokens tokens;	/* first, see tokcache_put() */
+	uint64_t key;
+	int refs;
+	int cached;		/* still reachable from the table */
+
+	struct entry *chain;	/* next in the bucket */
+	struct entry *prev, *next;	/* in LRU order, newest first */
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct entry *bucket[TOKCACHE_BUCKETS];
+static struct entry *newest, *oldest;
+static size_t budget = TOKCACHE_BUDGET, used;
+
+static void unlinkLRU(struct entry *e) {
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		newest = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		oldest = e->prev;
+	e->prev = e->next = NULL;
+}
+
+static void pushLRU(struct entry *e) {
+	e->prev = NULL;
+	e->next = newest;
+	if (newest)
+		newest->prev = e;
+	newest = e;
+	if (!oldest)
+		oldest = e;
+}
+
+static struct entry *lookup(uint64_t key) {
+	struct entry *e;
+
+	for (e = bucket[key % TOKCACHE_BUCKETS]; e; e = e->chain)
+		if (key == e->key)
+			return e;
+	return NULL;
+}
+
+static void drop(struct entry *e) {
+	struct entry **pp = &bucket[e->key % TOKCACHE_BUCKETS];
+
+	while (*pp != e)
+		pp = &(*pp)->chain;
+	*pp = e->chain;
+	unlinkLRU(e);
+	used -= e->tokens.bytes;
+	e->cached = 0;
+}
+
+static void destroy(struct entry *e) {
+	tokens_free(&e->tokens);
+	free(e);
+}
+
+/* evict idle entries, oldest first, until within budget */
+static void evict(void) {
+	struct entry *e = oldest, *prev;
+
+	for ( ; e && used > budget; e = prev) {
+		prev = e->prev;
+		if (0 == e->refs) {
+			drop(e);
+			destroy(e);
+		}
+	}
+}
+
+void tokcache_budget(size_t bytes) {
+	pthread_mutex_lock(&lock);
+	budget = bytes;
+	evict();
+	pthread_mutex_unlock(&lock);
+}
+
+/*
+	the tokens of text, whose content hash is key;
+	every successful get must be paired with a put
+*/
+const struct tokens *tokcache_get(uint64_t key, const char *text, size_t len) {
+	struct entry *e, *other;
+
+	pthread_mutex_lock(&lock);
+	if ((e = lookup(key))) {
+		++e->refs;
+		unlinkLRU(e);
+		pushLRU(e);
+		pthread_mutex_unlock(&lock);
+		return &e->tokens;
+	}
+	pthread_mutex_unlock(&lock);
+
+	/* tokenize outside the lock, others keep judging */
+	if (NULL == (e = calloc(1, sizeof *e)))
+		return NULL;
+	if (-1 == tokens_build(&e->tokens, text, len, hash_seed())) {
+		free(e);
+		return NULL;
+	}
+	e->key = key;
+	e->refs = 1;
+
+	pthread_mutex_lock(&lock);
+	if ((other = lookup(key))) {
+		/* somebody was faster */
+		++other->refs;
+		pthread_mutex_unlock(&lock);
+		destroy(e);
+		return &other->tokens;
+	}
+	if (e->tokens.bytes <= budget) {
+		e->chain = bucket[key % TOKCACHE_BUCKETS];
+		bucket[key % TOKCACHE_BUCKETS] = e;
+		pushLRU(e);
+		used += e->tokens.bytes;
+		e->cached = 1;
+		evict();
+	}
+	pthread_mutex_unlock(&lock);
+	return &e->tokens;
+}
+
+void tokcache_put(const struct tokens *t) {
+	struct entry *e = (struct entry *)t;
+
+	pthread_mutex_lock(&lock);
+	if (0 == --e->refs) {
+		if (!e->cached)
+			destroy(e);
+		else
+			evict();
+	}
+	pthread_mutex_unlock(&lock);
+}
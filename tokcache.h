@@ -0,0 +1,16 @@
+#ifndef TOKCACHE_H
+#define TOKCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "token.h"
+
+/* memory the resident tokens may hold by default */
+#define TOKCACHE_BUDGET (1 << 26)
+
+void tokcache_budget(size_t bytes);
+const struct tokens *tokcache_get(uint64_t key, const char *text, size_t len);
+void tokcache_put(const struct tokens *t);
+
+#endif
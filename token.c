@@ -0,0 +1,243 @@
+/*
+	Token comparison for numerical problems: outputs are
+	split at white space, tokens that are both numbers
+	match within the problem's absolute or relative
+	epsilon, any other token must match byte for byte.
+*/
+
+#include <math.h>
+
+#include "common.h"
+#include "problem.h"
+#include "token.h"
+#include "hash.h"
+
+/* longest token that is parsed without allocation */
+#define MAX_NUMBER_LEN 64
+
+/* white space as isspace() sees it in the "C" locale */
+static const unsigned char blank[256] = {
+	[' '] = 1, ['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1,
+};
+
+/* exactly representable powers of ten */
+static const double pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+	1e21, 1e22,
+};
+
+/*
+	parse a whole token as a decimal number, return 1 if
+	it is one; the result is correctly rounded: the fast
+	path is exact (Clinger), anything else goes to strtod
+*/
+int token_number(const char *s, size_t len, double *d) {
+	const char *p = s, *end = s + len;
+	uint64_t mantissa = 0;
+	int digits = 0, exp10 = 0, exp = 0, esign = 1, truncated = 0;
+	int negative = 0;
+	char buf[MAX_NUMBER_LEN + 1];
+
+	if (p < end && ('-' == *p || '+' == *p))
+		negative = '-' == *p++;
+
+	for ( ; p < end && isdigit((unsigned char)*p); ++p, ++digits) {
+		if (mantissa < 1000000000000000000ULL)
+			mantissa = mantissa * 10 + (*p - '0');
+		else {
+			truncated = 1;
+			++exp10;
+		}
+	}
+	if (p < end && '.' == *p) {
+		for (++p; p < end && isdigit((unsigned char)*p); ++p, ++digits) {
+			if (mantissa < 1000000000000000000ULL) {
+				mantissa = mantissa * 10 + (*p - '0');
+				--exp10;
+			} else if ('0' != *p)
+				truncated = 1;
+		}
+	}
+	if (0 == digits)
+		return 0;
+
+	if (p < end && ('e' == *p || 'E' == *p)) {
+		if (++p < end && ('-' == *p || '+' == *p))
+			esign = '-' == *p++ ? -1 : 1;
+		if (!(p < end && isdigit((unsigned char)*p)))
+			return 0;
+		for ( ; p < end && isdigit((unsigned char)*p); ++p)
+			if (exp < 100000)
+				exp = exp * 10 + (*p - '0');
+	}
+	if (p != end)
+		return 0;
+	exp10 += esign * exp;
+
+	/* both operands exact, so one IEEE operation rounds correctly */
+	if (!truncated && mantissa <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22) {
+		*d = (double)mantissa;
+		*d = exp10 < 0 ? *d / pow10[-exp10] : *d * pow10[exp10];
+		if (negative)
+			*d = -*d;
+		return 1;
+	}
+
+	/* the slow but correctly rounded path */
+	if (len <= MAX_NUMBER_LEN) {
+		memcpy(buf, s, len);
+		buf[len] = '\0';
+		*d = strtod(buf, NULL);
+	} else {
+		char *copy = strndup(s, len);
+
+		if (NULL == copy)
+			return 0;
+		*d = strtod(copy, NULL);
+		free(copy);
+	}
+	return 1;
+}
+
+/*
+	identical tokens match, numbers match within epsilon
+*/
+int token_equal(const struct problem *pb,
+	const char *a, size_t alen, const char *b, size_t blen) {
+	double x, y, delta;
+
+	if (alen == blen && 0 == memcmp(a, b, alen))
+		return 1;
+	if (!token_number(a, alen, &x) || !token_number(b, blen, &y))
+		return 0;
+
+	delta = fabs(x - y);
+	return delta <= pb->abs_eps || delta <= pb->rel_eps * fmax(fabs(x), fabs(y));
+}
+
+/*
+	cut the next token out of [*p, end), return 0 at the end
+*/
+static inline int nextToken(const char **p, const char *end,
+	const char **tok, size_t *len) {
+	const char *q = *p;
+
+	while (q < end && blank[(unsigned char)*q])
+		++q;
+	if (q == end)
+		return 0;
+	*tok = q;
+	while (q < end && !blank[(unsigned char)*q])
+		++q;
+	*len = q - *tok;
+	*p = q;
+	return 1;
+}
+
+/*
+	walk both outputs token by token, white space and
+	line structure are not significant in this mode;
+	s1 is the expected output, s2 the candidate's
+*/
+int token_compare(const struct problem *pb,
+	const char *s1, size_t n1, const char *s2, size_t n2, struct mismatch *m) {
+	const char *p1 = s1, *e1 = s1 + n1, *p2 = s2, *e2 = s2 + n2;
+	const char *t1, *t2;
+	size_t l1, l2;
+	int more1, more2;
+
+	for ( ; ; ) {
+		more1 = nextToken(&p1, e1, &t1, &l1);
+		more2 = nextToken(&p2, e2, &t2, &l2);
+		if (!(more1 && more2))
+			break;
+		if (!token_equal(pb, t1, l1, t2, l2))
+			goto DIFFER;
+	}
+	if (!(more1 || more2))
+		return ACCEPTED;
+DIFFER:
+	m->exp = more1 ? (size_t)(t1 - s1) : n1;
+	m->usr = more2 ? (size_t)(t2 - s2) : n2;
+	return WRONG_ANWSER;
+}
+
+/*
+	tokenize an expected output once, for token_match()
+*/
+int tokens_build(struct tokens *t, const char *text, size_t len, uint64_t seed) {
+	const char *p = text, *end = text + len, *tok;
+	size_t n, i = 0;
+	char *block = NULL;
+
+	memset(t, 0, sizeof *t);
+	t->seed = seed;
+
+	/* offsets are 32 bits wide */
+	if (len > UINT32_MAX)
+		return -1;
+
+	for (p = text; nextToken(&p, end, &tok, &n); )
+		++t->count;
+
+	t->bytes = t->count * (2 * sizeof(uint32_t) + sizeof(uint64_t) + sizeof(double));
+	if (t->count && NULL == (block = malloc(t->bytes)))
+		return -1;
+
+	/* one block, widest members first */
+	if (t->count) {
+		t->hash = (uint64_t *)block;
+		t->value = (double *)(t->hash + t->count);
+		t->offset = (uint32_t *)(t->value + t->count);
+		t->length = t->offset + t->count;
+	}
+
+	for (p = text; nextToken(&p, end, &tok, &n); ++i) {
+		t->offset[i] = tok - text;
+		t->length[i] = n;
+		t->hash[i] = hash64(tok, n, seed);
+		if (!token_number(tok, n, &t->value[i]))
+			t->value[i] = NAN;
+	}
+	return 0;
+}
+
+void tokens_free(struct tokens *t) {
+	free(t->hash);
+	memset(t, 0, sizeof *t);
+}
+
+/*
+	token_compare() against a pre-tokenized expected
+	output: only the candidate side is walked
+*/
+int token_match(const struct problem *pb, const struct tokens *t,
+	const char *usr, size_t len, struct mismatch *m) {
+	const char *p = usr, *end = usr + len, *tok;
+	size_t n, i;
+	double x, y, delta;
+
+	for (i = 0; nextToken(&p, end, &tok, &n); ++i) {
+		if (i == t->count)
+			goto DIFFER;
+		if (n == t->length[i] && hash64(tok, n, t->seed) == t->hash[i])
+			continue;
+
+		y = t->value[i];
+		if (isnan(y) || !token_number(tok, n, &x))
+			goto DIFFER;
+		delta = fabs(x - y);
+		if (!(delta <= pb->abs_eps || delta <= pb->rel_eps * fmax(fabs(x), fabs(y))))
+			goto DIFFER;
+	}
+	if (i == t->count)
+		return ACCEPTED;
+	tok = end;
+DIFFER:
+	/* past the last token if the expected output ran out */
+	m->usr = tok - usr;
+	m->exp = i < t->count ? t->offset[i]
+		: t->count ? t->offset[t->count - 1] + t->length[t->count - 1] : 0;
+	return WRONG_ANWSER;
+}
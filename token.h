@@ -0,0 +1,38 @@
+#ifndef TOKEN_H
+#define TOKEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct problem;
+struct mismatch;
+
+/*
+	an expected output split into tokens, kept as a
+	struct of arrays; a candidate token matches when
+	its length and seeded hash do, so the expected text
+	itself is not needed any more
+*/
+struct tokens {
+	size_t count;
+	uint32_t *offset;	/* into the text it was built from */
+	uint32_t *length;
+	uint64_t *hash;		/* hash64() with the seed below */
+	double *value;		/* NaN unless a number */
+
+	uint64_t seed;
+	size_t bytes;		/* memory held by the arrays */
+};
+
+int token_number(const char *s, size_t len, double *d);
+int token_equal(const struct problem *pb,
+	const char *a, size_t alen, const char *b, size_t blen);
+int token_compare(const struct problem *pb,
+	const char *s1, size_t n1, const char *s2, size_t n2, struct mismatch *m);
+
+int tokens_build(struct tokens *t, const char *text, size_t len, uint64_t seed);
+void tokens_free(struct tokens *t);
+int token_match(const struct problem *pb, const struct tokens *t,
+	const char *usr, size_t len, struct mismatch *m);
+
+#endif
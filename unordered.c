@@ -0,0 +1,113 @@
+/*
+	Order-insensitive comparison: the outputs must hold
+	the same multiset of lines, compared after trailing
+	blanks are stripped; empty lines do not count.
+	Only the distinct expected lines are stored, one
+	counter each, and the candidate is checked off in a
+	single pass, so no line is ever sorted.
+*/
+
+#include "common.h"
+#include "canon.h"
+#include "hash.h"
+#include "unordered.h"
+
+/* 16 bytes, millions of lines stay affordable */
+struct slot {
+	uint64_t hash;		/* 0 for an empty slot */
+	uint32_t offset;	/* first occurrence in the expected output */
+	uint32_t count;		/* occurrences not yet printed */
+};
+
+static inline uint64_t lineHash(const char *line, size_t len, uint64_t seed) {
+	uint64_t h = hash64(line, len, seed);
+
+	return h ? h : 1;
+}
+
+/*
+	the slot of a line, or the empty slot where it goes;
+	lines match by their seeded hash, which mixes in the
+	length and cannot be aimed at from outside
+*/
+static struct slot *probe(struct slot *table, size_t mask, uint64_t h) {
+	size_t i = h & mask;
+
+	while (table[i].hash && h != table[i].hash)
+		i = (i + 1) & mask;
+	return &table[i];
+}
+
+/*
+	cut the next non-empty line out of [*p, end)
+*/
+static inline int nextLine(const char **p, const char *end,
+	const char **line, size_t *len) {
+	const char *nl;
+
+	while (*p < end) {
+		nl = memchr(*p, '\n', end - *p);
+		*line = *p;
+		*len = canon_trim(*p, (nl ? nl : end) - *p);
+		*p = nl ? nl + 1 : end;
+		if (*len)
+			return 1;
+	}
+	return 0;
+}
+
+int unordered_compare(const char *exp, size_t elen,
+	const char *usr, size_t ulen, struct unordered_diff *d) {
+	const char *p, *end, *line;
+	size_t len, lines = 0, size = 2, i;
+	uint64_t seed = hash_seed(), h;
+	struct slot *table, *s, *first = NULL;
+
+	memset(d, 0, sizeof *d);
+
+	/* offsets are 32 bits wide */
+	if (elen > UINT32_MAX)
+		return SYSTEM_ERROR;
+
+	/* a load factor of at most three quarters */
+	for (p = exp, end = exp + elen; nextLine(&p, end, &line, &len); )
+		++lines;
+	while (3 * size < 4 * lines)
+		size <<= 1;
+	if (NULL == (table = calloc(size, sizeof *table)))
+		return SYSTEM_ERROR;
+
+	for (p = exp; nextLine(&p, end, &line, &len); ) {
+		h = lineHash(line, len, seed);
+		s = probe(table, size - 1, h);
+		if (0 == s->hash) {
+			s->hash = h;
+			s->offset = line - exp;
+		}
+		++s->count;
+	}
+
+	/* check off the candidate's lines */
+	for (p = usr, end = usr + ulen; nextLine(&p, end, &line, &len); ) {
+		s = probe(table, size - 1, lineHash(line, len, seed));
+		if (0 == s->count) {
+			d->line = line;
+			d->len = len;
+			free(table);
+			return WRONG_ANWSER;
+		}
+		--s->count;
+	}
+
+	/* report the earliest line left unprinted */
+	for (i = 0; i < size; ++i)
+		if (table[i].count && (!first || table[i].offset < first->offset))
+			first = &table[i];
+	if (first) {
+		p = exp + first->offset;
+		nextLine(&p, exp + elen, &d->line, &d->len);
+		d->missing = 1;
+	}
+	free(table);
+	return first ? WRONG_ANWSER : ACCEPTED;
+}
@@ -0,0 +1,16 @@
+#ifndef UNORDERED_H
+#define UNORDERED_H
+
+#include <stddef.h>
+
+/* the first line that tells two outputs apart */
+struct unordered_diff {
+	const char *line;	/* into the expected or candidate output */
+	size_t len;
+	int missing;		/* expected but not printed, else extra */
+};
+
+int unordered_compare(const char *exp, size_t elen,
+	const char *usr, size_t ulen, struct unordered_diff *d);
+
+#endif
@@ -0,0 +1,207 @@
+/*
+	Verdicts of past jobs, for a job that is the same
+	as one judged before: byte for byte the same source,
+	or the same binary out of the compiler, to the same
+	version of a problem, see compile_key() and
+	problem_version(). A class resubmitting unchanged
+	code, or handing in copies of it, gets its verdict
+	at once instead of a run.
+
+	A job whose twin is still being judged does not run
+	either; it follows the one ahead of it, and is told
+	the same verdict when that one is done.
+
+	Only a verdict the judge stands by is kept; after a
+	system error the followers are handed back to be
+	judged after all, and the verdict is forgotten.
+*/
+
+#include <pthread.h>
+
+#include "common.h"
+#include "vcache.h"
+
+struct entry {
+	uint64_t key;
+	long origin;		/* the job judged */
+
+	/* the verdict line and the diagnostics, once done */
+	int done;
+	char *status, *log;
+	size_t log_len;
+
+	/* jobs waiting on the verdict */
+	void **followers;
+	int nfollowers;
+
+	struct entry *next, *newer;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct entry *table[VCACHE_BUCKETS];
+
+/* done entries, from the oldest */
+static struct entry *oldest, *newest;
+static int kept;
+
+static long hits, coalesced, misses;
+
+static struct entry **find(uint64_t key) {
+	struct entry **e = &table[key % VCACHE_BUCKETS];
+
+	while (*e && (*e)->key != key)
+		e = &(*e)->next;
+	return e;
+}
+
+static void drop(struct entry **e) {
+	struct entry *gone = *e;
+
+	*e = gone->next;
+	free(gone->status);
+	free(gone->log);
+	free(gone->followers);
+	free(gone);
+}
+
+/*
+	an entry is done with its verdict, lock held; the
+	oldest make room for it
+*/
+static int settle(struct entry *e, const char *status, const char *log, size_t log_len) {
+	struct entry *old;
+
+	if (NULL == (e->status = strdup(status))
+		|| (log_len && NULL == (e->log = malloc(log_len))))
+		return -1;
+	if (log_len)
+		memcpy(e->log, log, log_len);
+	e->log_len = log_len;
+	e->done = 1;
+
+	if (newest)
+		newest->newer = e;
+	else
+		oldest = e;
+	newest = e;
+	for (++kept; kept > VCACHE_ENTRIES; --kept) {
+		old = oldest;
+		if (NULL == (oldest = old->newer))
+			newest = NULL;
+		drop(find(old->key));
+	}
+	return 0;
+}
+
+static void tell(const struct entry *e, FILE *out, FILE *err, long *origin) {
+	fputs(e->status, out);
+	fwrite(e->log, 1, e->log_len, err);
+	*origin = e->origin;
+}
+
+/*
+	the verdict of key if it is known; otherwise job id
+	judges it, or follower waits on whoever does
+*/
+int vcache_claim(uint64_t key, long id, void *follower, FILE *out, FILE *err, long *origin) {
+	struct entry **e, *n;
+	void **more;
+	int result = VCACHE_MISS;
+
+	pthread_mutex_lock(&lock);
+	if (*(e = find(key))) {
+		if ((*e)->done) {
+			tell(*e, out, err, origin);
+			hits++;
+			result = VCACHE_HIT;
+		} else if ((more = realloc((*e)->followers,
+			((*e)->nfollowers + 1) * sizeof *more))) {
+			(*e)->followers = more;
+			more[(*e)->nfollowers++] = follower;
+			*origin = (*e)->origin;
+			coalesced++;
+			result = VCACHE_FOLLOW;
+		}
+	} else if ((n = calloc(1, sizeof *n))) {
+		n->key = key;
+		n->origin = id;
+		*e = n;
+		misses++;
+	}
+	pthread_mutex_unlock(&lock);
+	return result;
+}
+
+/*
+	the verdict of key if it is known, for a job that
+	claimed another key first and counts once
+*/
+int vcache_lookup(uint64_t key, FILE *out, FILE *err, long *origin) {
+	struct entry **e;
+	int result = VCACHE_MISS;
+
+	pthread_mutex_lock(&lock);
+	if (*(e = find(key)) && (*e)->done) {
+		tell(*e, out, err, origin);
+		hits++;
+		misses--;
+		result = VCACHE_HIT;
+	}
+	pthread_mutex_unlock(&lock);
+	return result;
+}
+
+/*
+	keep a verdict no one claimed first, as that of a
+	binary
+*/
+void vcache_put(uint64_t key, long id, const char *status, const char *log, size_t log_len) {
+	struct entry **e, *n;
+
+	pthread_mutex_lock(&lock);
+	if (NULL == *(e = find(key)) && (n = calloc(1, sizeof *n))) {
+		n->key = key;
+		n->origin = id;
+		*e = n;
+		if (-1 == settle(n, status, log, log_len))
+			drop(e);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+/*
+	the verdict of a claimed key, kept unless told not
+	to; hands back the jobs that followed, for the
+	caller to free, and to claim again if not kept
+*/
+int vcache_finish(uint64_t key, const char *status, const char *log, size_t log_len,
+	int keep, void ***followers) {
+	struct entry **e;
+	int n = 0;
+
+	*followers = NULL;
+	pthread_mutex_lock(&lock);
+	if (*(e = find(key)) && !(*e)->done) {
+		*followers = (*e)->followers;
+		n = (*e)->nfollowers;
+		(*e)->followers = NULL;
+		(*e)->nfollowers = 0;
+		if (!keep)
+			coalesced -= n;
+		if (!keep || -1 == settle(*e, status, log, log_len))
+			drop(e);
+	}
+	pthread_mutex_unlock(&lock);
+	return n;
+}
+
+void vcache_report(FILE *fp) {
+	long total;
+
+	pthread_mutex_lock(&lock);
+	total = hits + coalesced + misses;
+	fprintf(fp, "vcache: %ld hits, %ld coalesced, %ld judged, %.1f%% saved, %d kept\n",
+		hits, coalesced, misses,
+		total ? 100.0 * (hits + coalesced) / total : 0, kept);
+	pthread_mutex_unlock(&lock);
+}
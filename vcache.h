@@ -0,0 +1,26 @@
+#ifndef VCACHE_H
+#define VCACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* verdicts kept, the oldest go first */
+#define VCACHE_ENTRIES 4096
+
+/* buckets of the table */
+#define VCACHE_BUCKETS 1024
+
+enum {
+	VCACHE_MISS,		/* the caller judges, and finishes the entry */
+	VCACHE_HIT,		/* the verdict is written out */
+	VCACHE_FOLLOW,		/* the same job is being judged already */
+};
+
+int vcache_claim(uint64_t key, long id, void *follower, FILE *out, FILE *err, long *origin);
+int vcache_lookup(uint64_t key, FILE *out, FILE *err, long *origin);
+void vcache_put(uint64_t key, long id, const char *status, const char *log, size_t log_len);
+int vcache_finish(uint64_t key, const char *status, const char *log, size_t log_len,
+	int keep, void ***followers);
+void vcache_report(FILE *fp);
+
+#endif
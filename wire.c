@@ -0,0 +1,220 @@
+/*
+	The connection between judged and its workers, see
+	remote.c and worker.c: lines of text, some followed
+	by as many bytes as they say. A read gives up after
+	timeout ms without a byte, with errno ETIMEDOUT; a
+	timeout of -1 waits for as long as it takes.
+
+	A worker answers the challenge of judged with the
+	HMAC of it and its name under the key they share.
+*/
+
+#include "common.h"
+#include "hmac.h"
+#include "wire.h"
+
+#include <sys/sendfile.h>
+#include <sys/random.h>
+#include <stdarg.h>
+#include <poll.h>
+
+void wire_init(struct wire *w, int fd) {
+	w->fd = fd;
+	w->off = w->len = 0;
+}
+
+/*
+	more into the buffer, once it is used up
+*/
+static int fill(struct wire *w, int timeout) {
+	struct pollfd pfd = { w->fd, POLLIN, 0 };
+	ssize_t n;
+
+	if (w->off == w->len)
+		w->off = w->len = 0;
+	if (w->off) {
+		memmove(w->buf, w->buf + w->off, w->len - w->off);
+		w->len -= w->off;
+		w->off = 0;
+	}
+	switch (poll(&pfd, 1, timeout)) {
+	case -1:
+		return -1;
+	case 0:
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	if ((n = read(w->fd, w->buf + w->len, sizeof w->buf - w->len)) <= 0) {
+		if (0 == n)
+			errno = ECONNRESET;
+		return -1;
+	}
+	w->len += n;
+	return 0;
+}
+
+/*
+	the next line, without its '\n'
+*/
+int wire_line(struct wire *w, char *line, size_t size, int timeout) {
+	char *nl;
+	size_t n;
+
+	while (NULL == (nl = memchr(w->buf + w->off, '\n', w->len - w->off))) {
+		/* a line that long is not spoken */
+		if (w->len - w->off >= size) {
+			errno = EPROTO;
+			return -1;
+		}
+		if (-1 == fill(w, timeout))
+			return -1;
+	}
+	n = nl - (w->buf + w->off);
+	if (n >= size) {
+		errno = EPROTO;
+		return -1;
+	}
+	memcpy(line, w->buf + w->off, n);
+	line[n] = '\0';
+	w->off += n + 1;
+	return 0;
+}
+
+int wire_read(struct wire *w, void *buf, size_t n, int timeout) {
+	size_t k;
+
+	for ( ; n; n -= k, buf = (char *)buf + k) {
+		if (w->off == w->len && -1 == fill(w, timeout))
+			return -1;
+		k = w->len - w->off < n ? w->len - w->off : n;
+		memcpy(buf, w->buf + w->off, k);
+		w->off += k;
+	}
+	return 0;
+}
+
+/*
+	the next n bytes, written to fd
+*/
+int wire_save(struct wire *w, int fd, size_t n, int timeout) {
+	size_t k;
+
+	for ( ; n; n -= k) {
+		if (w->off == w->len && -1 == fill(w, timeout))
+			return -1;
+		k = w->len - w->off < n ? w->len - w->off : n;
+		if (-1 == wire_write(fd, w->buf + w->off, k))
+			return -1;
+		w->off += k;
+	}
+	return 0;
+}
+
+int wire_write(int fd, const void *buf, size_t n) {
+	ssize_t k;
+
+	for ( ; n; n -= k, buf = (const char *)buf + k)
+		if ((k = write(fd, buf, n)) < 0) {
+			if (EINTR != errno)
+				return -1;
+			k = 0;
+		}
+	return 0;
+}
+
+int wire_printf(int fd, const char *fmt, ...) {
+	char line[WIRE_LINE];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(line, sizeof line, fmt, ap);
+	va_end(ap);
+	if (n < 0 || n >= sizeof line)
+		return -1;
+	return wire_write(fd, line, n);
+}
+
+/*
+	size bytes of the file at path; one that is no
+	longer that size fails, as the other side counts
+*/
+int wire_file(int fd, const char *path, size_t size) {
+	int in = open(path, O_RDONLY | O_CLOEXEC);
+	off_t off = 0;
+	ssize_t n;
+
+	if (-1 == in)
+		return -1;
+	while ((size_t)off < size)
+		if ((n = sendfile(fd, in, &off, size - off)) <= 0) {
+			close(in);
+			return -1;
+		}
+	close(in);
+	return 0;
+}
+
+static unsigned char key[WIRE_KEY];
+static size_t key_len;
+
+/*
+	the shared key, from a file; a newline ending it
+	is not part of it
+*/
+int wire_key(const char *path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	ssize_t n;
+
+	if (-1 == fd)
+		return -1;
+	n = read(fd, key, sizeof key);
+	close(fd);
+	if (n < 0 || sizeof key == n)
+		return -1;
+	for (key_len = n; key_len && '\n' == key[key_len - 1]; --key_len)
+		;
+	return key_len ? 0 : -1;
+}
+
+static void hex(char *out, const unsigned char *p, size_t n) {
+	size_t i;
+
+	for (i = 0; i < n; ++i)
+		sprintf(out + 2 * i, "%02x", p[i]);
+	out[2 * n] = '\0';
+}
+
+int wire_challenge(char *out) {
+	unsigned char nonce[WIRE_NONCE];
+
+	if (sizeof nonce != getrandom(nonce, sizeof nonce, 0))
+		return -1;
+	hex(out, nonce, sizeof nonce);
+	return 0;
+}
+
+void wire_answer(const char *challenge, const char *name, char *out) {
+	unsigned char digest[HMAC_SIZE];
+	char msg[WIRE_LINE];
+	int n = snprintf(msg, sizeof msg, "%s %s", challenge, name);
+
+	hmac_sha256(key, key_len, msg, n < sizeof msg ? n : sizeof msg - 1, digest);
+	hex(out, digest, sizeof digest);
+}
+
+/*
+	0 if answer is the one to challenge, compared in
+	the same time however much of it is right
+*/
+int wire_check(const char *challenge, const char *name, const char *answer) {
+	char want[WIRE_HEX];
+	int i, diff = 0;
+
+	wire_answer(challenge, name, want);
+	if (strlen(answer) != WIRE_HEX - 1)
+		return -1;
+	for (i = 0; i < WIRE_HEX - 1; ++i)
+		diff |= want[i] ^ answer[i];
+	return diff ? -1 : 0;
+}
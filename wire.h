@@ -0,0 +1,40 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stddef.h>
+
+/* read ahead of a connection */
+#define WIRE_BUFFER (1 << 16)
+
+/* the longest line spoken */
+#define WIRE_LINE 512
+
+/* the longest key shared by judged and its workers */
+#define WIRE_KEY 1024
+
+/* bytes of a challenge */
+#define WIRE_NONCE 16
+
+/* a challenge, or an answer to it, in hex */
+#define WIRE_HEX 65
+
+/* a connection, read by lines or by lengths of bytes */
+struct wire {
+	int fd;
+	char buf[WIRE_BUFFER];
+	size_t off, len;
+};
+
+void wire_init(struct wire *w, int fd);
+int wire_line(struct wire *w, char *line, size_t size, int timeout);
+int wire_read(struct wire *w, void *buf, size_t n, int timeout);
+int wire_save(struct wire *w, int fd, size_t n, int timeout);
+int wire_write(int fd, const void *buf, size_t n);
+int wire_printf(int fd, const char *fmt, ...);
+int wire_file(int fd, const char *path, size_t size);
+int wire_key(const char *path);
+int wire_challenge(char *hex);
+void wire_answer(const char *challenge, const char *name, char *hex);
+int wire_check(const char *challenge, const char *name, const char *answer);
+
+#endif
@@ -0,0 +1,404 @@
+/*
+	worker judges for a judged on another host, the one
+	started with -p port; see remote.c for what they say.
+
+		worker [-s slots] [-M memory_mb] -k key_file host:port store
+
+	The key file is the one judged was given by -k.
+
+	It connects once for each of its slots, and again
+	whenever it loses the connection. The files of the
+	problems it is sent are kept in the store by their
+	hash, and each problem as a folder of links to them,
+	store/p-HASH, loaded once with its checker.
+*/
+
+#include "common.h"
+#include "problem.h"
+#include "spj.h"
+#include "judge.h"
+#include "admit.h"
+#include "hash.h"
+#include "wire.h"
+#include "remote.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdarg.h>
+
+#define USAGE "Usage: worker [-s slots] [-M memory_mb] -k key_file host:port store_dir"
+
+/* a connection to judged */
+struct slot {
+	struct wire wire;
+	pthread_mutex_t lock;	/* of writing, which the beat does too */
+	int fd;
+
+	/* the files of a problem being sent */
+	struct entry {
+		unsigned long long hash;
+		char name[NAME_MAX + 1];
+	} *entry;
+	int entries;
+	unsigned long long problem;
+};
+
+/* a problem loaded once, with its checker */
+struct warm {
+	unsigned long long hash;
+	struct problem pb;
+	struct spj spj;
+	struct warm *next;
+};
+
+static char store[PATH_MAX], name[64];
+static const char *host, *port;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct warm *problems;
+
+static int say(struct slot *sl, const char *fmt, ...) {
+	char line[WIRE_LINE];
+	va_list ap;
+	int n, result;
+
+	va_start(ap, fmt);
+	n = vsnprintf(line, sizeof line, fmt, ap);
+	va_end(ap);
+	if (n < 0 || n >= sizeof line)
+		return -1;
+	pthread_mutex_lock(&sl->lock);
+	result = wire_write(sl->fd, line, n);
+	pthread_mutex_unlock(&sl->lock);
+	return result;
+}
+
+static int dial(void) {
+	struct addrinfo hints, *ai, *p;
+	int fd = -1, one = 1;
+
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &ai))
+		return -1;
+	for (p = ai; p; p = p->ai_next) {
+		if (-1 == (fd = socket(p->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0)))
+			continue;
+		if (0 == connect(fd, p->ai_addr, p->ai_addrlen))
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(ai);
+	if (-1 != fd)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+	return fd;
+}
+
+static void folderOf(char *path, size_t size, unsigned long long hash) {
+	snprintf(path, size, "%s/p-%016llx", store, hash);
+}
+
+static void fileOf(char *path, size_t size, unsigned long long hash) {
+	snprintf(path, size, "%s/%016llx", store, hash);
+}
+
+/*
+	the files listed for a problem, and which of them
+	are wanted
+*/
+static int list(struct slot *sl) {
+	char line[WIRE_LINE], path[PATH_MAX];
+	struct entry *e;
+	size_t size;
+	int i, k;
+
+	sl->entries = 0;
+	for ( ; ; ) {
+		if (-1 == wire_line(&sl->wire, line, sizeof line, REMOTE_TIMEOUT))
+			return -1;
+		if (0 == strcmp(line, "end"))
+			break;
+		if (NULL == (e = realloc(sl->entry, (sl->entries + 1) * sizeof *e)))
+			return -1;
+		sl->entry = e;
+		e = &sl->entry[sl->entries];
+		if (3 != sscanf(line, "%llx %zu %255s", &e->hash, &size, e->name)
+			|| '.' == *e->name || strchr(e->name, '/'))
+			return -1;
+		sl->entries++;
+	}
+	for (i = 0; i < sl->entries; ++i) {
+		for (k = 0; k < i && sl->entry[k].hash != sl->entry[i].hash; ++k)
+			;
+		fileOf(path, sizeof path, sl->entry[i].hash);
+		if (k == i && -1 == access(path, F_OK)
+			&& -1 == say(sl, "need %016llx\n", sl->entry[i].hash))
+			return -1;
+	}
+	return say(sl, "ready\n");
+}
+
+/*
+	a file comes whole into the store, or not at all
+*/
+static int receive(struct slot *sl, unsigned long long hash, size_t size) {
+	char tmp[PATH_MAX], path[PATH_MAX];
+	int fd;
+
+	if (sizeof tmp <= snprintf(tmp, sizeof tmp, "%s/.%016llx.XXXXXX", store, hash)
+		|| -1 == (fd = mkstemp(tmp)))
+		return -1;
+	if (-1 == wire_save(&sl->wire, fd, size, REMOTE_TIMEOUT) || close(fd)) {
+		unlink(tmp);
+		return -1;
+	}
+	fileOf(path, sizeof path, hash);
+	if (hash_file(tmp, 0) != hash || -1 == rename(tmp, path)) {
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+	the folder of the problem last listed, of links into
+	the store; another slot may make it first
+*/
+static int build(struct slot *sl) {
+	char tmp[PATH_MAX], dir[PATH_MAX], from[PATH_MAX], to[PATH_MAX];
+	int i, made = 0, result = 0;
+
+	if (sizeof tmp <= snprintf(tmp, sizeof tmp, "%s/.p-%016llx.XXXXXX", store, sl->problem)
+		|| NULL == mkdtemp(tmp))
+		return -1;
+	for (i = 0; i < sl->entries && !result; ++i, ++made) {
+		fileOf(from, sizeof from, sl->entry[i].hash);
+		if (sizeof to <= snprintf(to, sizeof to, "%s/%s", tmp, sl->entry[i].name))
+			result = -1;
+		else
+			result = link(from, to);
+	}
+	folderOf(dir, sizeof dir, sl->problem);
+	if (0 == result && 0 == rename(tmp, dir))
+		return 0;
+
+	while (made--)
+		if (sizeof to > snprintf(to, sizeof to, "%s/%s", tmp, sl->entry[made].name))
+			unlink(to);
+	rmdir(tmp);
+	return 0 == access(dir, F_OK) ? 0 : -1;
+}
+
+static struct problem *warmProblem(unsigned long long hash) {
+	char dir[PATH_MAX];
+	struct warm *w;
+
+	pthread_mutex_lock(&lock);
+	for (w = problems; w && w->hash != hash; w = w->next)
+		;
+	if (!w && (w = calloc(1, sizeof *w))) {
+		folderOf(dir, sizeof dir, hash);
+		w->hash = hash;
+		if (-1 == problem_load(&w->pb, dir)
+			|| (*w->pb.checker && -1 == spj_open(&w->spj, &w->pb))) {
+			free(w);
+			w = NULL;
+		} else {
+			if (*w->pb.checker)
+				w->pb.spj = &w->spj;
+			w->next = problems;
+			problems = w;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	return w ? &w->pb : NULL;
+}
+
+static void progress(const struct testcase *tc, void *arg) {
+	say(arg, "test %d %d %ld %ld\n", tc->num, tc->result, tc->time, tc->memory);
+}
+
+/*
+	judge the binary that comes next; a problem that
+	cannot be judged here drops the connection, so that
+	judged tries the job elsewhere
+*/
+static int run(struct slot *sl, int jobs, size_t size) {
+	char bin[PATH_MAX], *status = NULL, *log = NULL, head[WIRE_LINE];
+	size_t status_len = 0, log_len = 0;
+	const struct problem *pb;
+	struct suite s;
+	FILE *out, *err;
+	int fd, n, result;
+
+	if (sl->entries && -1 == build(sl))
+		fprintf(stderr, "building problem %016llx Failed\n", sl->problem);
+	sl->entries = 0;
+	if (NULL == (pb = warmProblem(sl->problem)) || -1 == suite_open(&s, pb->dir, pb)) {
+		fprintf(stderr, "loading problem %016llx Failed\n", sl->problem);
+		return -1;
+	}
+
+	/* the binary lives in the workspace of the suite */
+	if (sizeof bin <= snprintf(bin, sizeof bin, "%s/main", s.dir)
+		|| -1 == (fd = open(bin, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755))) {
+		suite_close(&s);
+		return -1;
+	}
+	result = wire_save(&sl->wire, fd, size, REMOTE_TIMEOUT);
+	if (close(fd) || -1 == result) {
+		suite_close(&s);
+		return -1;
+	}
+
+	out = open_memstream(&status, &status_len);
+	err = open_memstream(&log, &log_len);
+	if (!out || !err)
+		EXIT_MSG("open_memstream() Failed", EXIT_FAILURE);
+	s.progress = progress;
+	s.arg = sl;
+	result = suite_run(&s, bin, jobs);
+	suite_report(&s, out, err);
+	suite_close(&s);
+	fclose(out);
+	fclose(err);
+
+	/* the verdict goes in one piece, between beats */
+	n = snprintf(head, sizeof head, "done %d %zu %zu\n", result, status_len, log_len);
+	pthread_mutex_lock(&sl->lock);
+	result = wire_write(sl->fd, head, n) || wire_write(sl->fd, status, status_len)
+		|| wire_write(sl->fd, log, log_len) ? -1 : 0;
+	pthread_mutex_unlock(&sl->lock);
+	free(status);
+	free(log);
+	return result;
+}
+
+/*
+	one request of judged; -1 once the connection is
+	no good
+*/
+static int serve(struct slot *sl) {
+	char line[WIRE_LINE], path[PATH_MAX];
+	unsigned long long hash;
+	size_t size;
+	int jobs;
+
+	if (-1 == wire_line(&sl->wire, line, sizeof line, -1))
+		return -1;
+	if (1 == sscanf(line, "problem %llx", &hash)) {
+		sl->problem = hash;
+		sl->entries = 0;
+		folderOf(path, sizeof path, hash);
+		if (0 == access(path, F_OK))
+			return say(sl, "have\n");
+		return say(sl, "list\n") || list(sl) ? -1 : 0;
+	}
+	if (2 == sscanf(line, "file %llx %zu", &hash, &size))
+		return receive(sl, hash, size);
+	if (2 == sscanf(line, "run %d %zu", &jobs, &size) && jobs > 0)
+		return run(sl, jobs, size);
+	return -1;
+}
+
+/*
+	prove to judged that this worker has its key
+*/
+static int answer(struct slot *sl) {
+	char line[WIRE_LINE], nonce[WIRE_HEX], hmac[WIRE_HEX];
+
+	if (-1 == wire_line(&sl->wire, line, sizeof line, REMOTE_TIMEOUT)
+		|| 1 != sscanf(line, "challenge %64s", nonce))
+		return -1;
+	wire_answer(nonce, name, hmac);
+	return say(sl, "answer %s\n", hmac);
+}
+
+static void *connection(void *arg) {
+	struct slot *sl = arg;
+	int fd;
+
+	for ( ; ; ) {
+		if (-1 == (fd = dial())) {
+			sleep(1);
+			continue;
+		}
+		pthread_mutex_lock(&sl->lock);
+		sl->fd = fd;
+		wire_init(&sl->wire, fd);
+		pthread_mutex_unlock(&sl->lock);
+
+		if (0 == say(sl, "hello %s\n", name) && 0 == answer(sl))
+			while (0 == serve(sl))
+				;
+		pthread_mutex_lock(&sl->lock);
+		close(sl->fd);
+		sl->fd = -1;
+		pthread_mutex_unlock(&sl->lock);
+		sleep(1);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+	struct timespec beat = { REMOTE_BEAT / 1000, REMOTE_BEAT % 1000 * 1000000L };
+	int opt, i, n, slots = sysconf(_SC_NPROCESSORS_ONLN);
+	char host_name[48], *colon;
+	const char *key = NULL;
+	struct slot *slot;
+	pthread_t thread;
+
+	while (-1 != (opt = getopt(argc, argv, "s:M:k:")))
+		if ('s' == opt && (slots = atoi(optarg)) > 0)
+			continue;
+		else if ('k' == opt)
+			key = optarg;
+		else if ('M' == opt && (n = atoi(optarg)) > 0)
+			admit_budget((size_t)n << 20);
+		else
+			EXIT_MSG(USAGE, EXIT_FAILURE);
+	if (2 != argc - optind || !key || NULL == (colon = strrchr(argv[optind], ':')))
+		EXIT_MSG(USAGE, EXIT_FAILURE);
+	if (-1 == wire_key(key))
+		EXIT_MSG("wire_key() Failed", EXIT_FAILURE);
+	if (slots < 1)
+		slots = 1;
+	*colon = '\0';
+	host = argv[optind];
+	port = colon + 1;
+
+	if (-1 == mkdir(argv[optind + 1], 0755) && EEXIST != errno)
+		EXIT_MSG("mkdir() Failed", EXIT_FAILURE);
+	if (NULL == realpath(argv[optind + 1], store))
+		EXIT_MSG("realpath() Failed", EXIT_FAILURE);
+	gethostname(host_name, sizeof host_name);
+	host_name[sizeof host_name - 1] = '\0';
+	snprintf(name, sizeof name, "%s:%d", host_name, (int)getpid());
+	signal(SIGPIPE, SIG_IGN);
+
+	if (NULL == (slot = calloc(slots, sizeof *slot)))
+		EXIT_MSG("calloc() Failed", EXIT_FAILURE);
+	for (i = 0; i < slots; ++i) {
+		slot[i].fd = -1;
+		pthread_mutex_init(&slot[i].lock, NULL);
+		if (pthread_create(&thread, NULL, connection, &slot[i]))
+			EXIT_MSG("pthread_create() Failed", EXIT_FAILURE);
+		pthread_detach(thread);
+	}
+
+	/* alive, on every connection, busy or not */
+	for ( ; ; ) {
+		nanosleep(&beat, NULL);
+		for (i = 0; i < slots; ++i) {
+			pthread_mutex_lock(&slot[i].lock);
+			if (-1 != slot[i].fd && -1 == wire_write(slot[i].fd, "beat\n", 5))
+				shutdown(slot[i].fd, SHUT_RDWR);
+			pthread_mutex_unlock(&slot[i].lock);
+		}
+	}
+}